@@ -0,0 +1,306 @@
+// Startup autotuner (see autotune.h).
+
+#include <fcntl.h>
+#include <ncurses.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "autotune.h"
+#include "render.h"
+
+#define TUNE_S     0.004  // timing window per candidate
+#define TUNE_WARM  16     // frames before timing starts
+#define TUNE_FRAMES 16    // frames replayed through each backend
+
+static const char *kernel_names[] = {"expa", "lut", "eigen"};
+static const char *precision_names[] = {"exact", "balanced", "fast"};
+static const char *isa_names[] = {"auto", "sse2", "avx2", "avx512"};
+static const char *backend_names[] = {"ncurses", "ansi"};
+
+#define COUNT(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+static double now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static int lookup(const char *const *names, int n, const char *s) {
+  for (int i = 0; i < n; i++)
+    if (!strcmp(names[i], s)) return i;
+  return -1;
+}
+
+// ---------------------------------------------------------------------------
+// Cache
+
+// The cache file's path, creating its directories first if mkdirs is set.
+// Empty when there is neither XDG_CACHE_HOME nor HOME.
+static void cache_path(char *buf, size_t len, int mkdirs) {
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  buf[0] = 0;
+  if (xdg && *xdg) snprintf(buf, len, "%s/ematrix/autotune", xdg);
+  else if (home && *home) snprintf(buf, len, "%s/.cache/ematrix/autotune", home);
+  else return;
+  for (char *s = buf + 1; mkdirs && (s = strchr(s, '/')); s++) {
+    *s = 0;
+    mkdir(buf, 0700);  // EEXIST is fine; anything else shows up at fopen
+    *s = '/';
+  }
+}
+
+static void cpu_model(char *buf, size_t len) {
+  snprintf(buf, len, "unknown");
+  FILE *f = fopen("/proc/cpuinfo", "r");
+  if (!f) return;
+  char line[256];
+  while (fgets(line, sizeof(line), f)) {
+    char *colon = strchr(line, ':');
+    if (strncmp(line, "model name", 10) || !colon) continue;
+    colon += strspn(colon + 1, " ") + 1;
+    colon[strcspn(colon, "\n")] = 0;
+    snprintf(buf, len, "%s", colon);
+    break;
+  }
+  fclose(f);
+}
+
+// Screens whose cell counts are within a factor of two of each other share
+// a cache line: the class is the cell count rounded up to a power of two.
+static long size_class(int rows, int cols) {
+  long cells = (long)rows * cols, c = 1;
+  while (c < cells) c <<= 1;
+  return c;
+}
+
+// CPU model, terminal type, the options that change what is tried or how
+// fast it runs, the particle count (0: the size's default) and the size.
+static void cache_key(const em_config *cfg, int rows, int cols, int what, char *buf,
+                      size_t len) {
+  char cpu[128];
+  const char *term = getenv("TERM");
+  cpu_model(cpu, sizeof(cpu));
+  int l = snprintf(buf, len, "%s|%s|%s%s%s%s%s|n%d|s%ld", cpu, term ? term : "-",
+                   (what & TUNE_BACKEND) ? "b" : "", cfg->truecolor ? "t" : "",
+                   cfg->compact ? "c" : "", cfg->events ? "e" : "", cfg->sort ? "s" : "",
+                   cfg->particles, size_class(rows, cols));
+  // Fixed choices are part of the key rather than of the answer.
+  if (!(what & TUNE_KERNEL) && l > 0 && (size_t)l < len)
+    l += snprintf(buf + l, len - (size_t)l, "|%s", kernel_names[cfg->kernel]);
+  if (!(what & TUNE_PRECISION) && l > 0 && (size_t)l < len)
+    l += snprintf(buf + l, len - (size_t)l, "|%s", precision_names[cfg->precision]);
+  if (!(what & TUNE_ISA) && l > 0 && (size_t)l < len)
+    snprintf(buf + l, len - (size_t)l, "|%s", isa_names[cfg->isa]);
+}
+
+// Lines are "KEY\tkernel precision isa backend".
+static int cache_load(const char *key, int what, TuneChoice *ch) {
+  char path[512], line[512];
+  cache_path(path, sizeof(path), 0);
+  FILE *f = path[0] ? fopen(path, "r") : NULL;
+  if (!f) return 0;
+  int found = 0;
+  size_t klen = strlen(key);
+  while (!found && fgets(line, sizeof(line), f)) {
+    if (strncmp(line, key, klen) || line[klen] != '\t') continue;
+    char k[16], p[16], i[16], b[16];
+    if (sscanf(line + klen + 1, "%15s %15s %15s %15s", k, p, i, b) != 4) continue;
+    int kernel = lookup(kernel_names, COUNT(kernel_names), k);
+    int precision = lookup(precision_names, COUNT(precision_names), p);
+    int isa = lookup(isa_names, COUNT(isa_names), i);
+    int backend = lookup(backend_names, COUNT(backend_names), b);
+    // A stale entry (other build, CPU flags masked) is just retuned.
+    if (kernel < 0 || precision < 0 || isa < 0 || !em_isa_supported(isa) ||
+        ((what & TUNE_BACKEND) && backend < 0))
+      continue;
+    ch->kernel = kernel;
+    ch->precision = precision;
+    ch->isa = isa;
+    if (what & TUNE_BACKEND) ch->backend = backend_names[backend];
+    found = 1;
+  }
+  fclose(f);
+  return found;
+}
+
+// Replace (or add) key's line, through a temporary file so a concurrent
+// reader never sees half a cache.
+static void cache_store(const char *key, const TuneChoice *ch) {
+  char path[512], tmp[600], line[512];
+  cache_path(path, sizeof(path), 1);
+  if (!path[0]) return;
+  snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+  FILE *out = fopen(tmp, "w");
+  if (!out) return;
+  FILE *in = fopen(path, "r");
+  size_t klen = strlen(key);
+  while (in && fgets(line, sizeof(line), in))
+    if (strncmp(line, key, klen) || line[klen] != '\t') fputs(line, out);
+  if (in) fclose(in);
+  fprintf(out, "%s\t%s %s %s %s\n", key, kernel_names[ch->kernel],
+          precision_names[ch->precision], isa_names[ch->isa],
+          ch->backend ? ch->backend : "-");
+  if (fclose(out) != 0 || rename(tmp, path) != 0) unlink(tmp);
+}
+
+// ---------------------------------------------------------------------------
+// Measurement
+
+// Seconds per em_step for cfg, alternating the green and black-hole looks.
+static double time_sim(const em_config *cfg, int rows, int cols) {
+  em_ctx *sim = em_create(cfg, rows, cols);
+  if (!sim) return -1.0;
+  double t = 0.0;
+  for (int i = 0; i < TUNE_WARM; i++) em_step(sim, t += 1.0 / 200.0);
+  int frames = 0;
+  double start = now_s(), end = start;
+  while (end - start < TUNE_S) {
+    em_set_mode(sim, (frames >> 3) & 1);
+    em_step(sim, t += 1.0 / 200.0);
+    frames++;
+    end = now_s();
+  }
+  em_destroy(sim);
+  return (end - start) / frames;
+}
+
+// Seconds per frame to present frames through be, which writes to
+// /dev/null: encoding and the write() itself, not the terminal's side.
+static double time_backend(Backend *be, const em_cell *frames, int rows, int cols) {
+  if (!be) return -1.0;
+  Screen screen = {0};
+  screen_resize(&screen, rows, cols);
+  be->resize(be, rows, cols);
+  size_t n = (size_t)rows * (size_t)cols;
+  long k = 0;
+  double start = now_s(), end = start;
+  while (end - start < TUNE_S || k < TUNE_FRAMES) {
+    be->begin_frame(be);
+    screen_present(&screen, be, frames + (size_t)(k % TUNE_FRAMES) * n, -1);
+    be->end_frame(be);
+    k++;
+    end = now_s();
+  }
+  screen_free(&screen);
+  be->destroy(be);
+  return (end - start) / k;
+}
+
+static double tune_backends(const em_config *cfg, int rows, int cols, TuneChoice *ch) {
+  // Frames to replay: the busier black-hole look.
+  size_t n = (size_t)rows * (size_t)cols;
+  em_cell *frames = (em_cell *)malloc(TUNE_FRAMES * n * sizeof(em_cell));
+  em_ctx *sim = frames ? em_create(cfg, rows, cols) : NULL;
+  if (!sim) {
+    free(frames);
+    return 0.0;
+  }
+  em_set_mode(sim, 1);
+  double t = 0.0;
+  for (int i = 0; i < TUNE_WARM; i++) em_step(sim, t += 1.0 / 200.0);
+  for (int i = 0; i < TUNE_FRAMES; i++) {
+    em_step(sim, t += 1.0 / 200.0);
+    memcpy(frames + (size_t)i * n, em_cells(sim, NULL, NULL), n * sizeof(em_cell));
+  }
+  em_destroy(sim);
+
+  Palette pal;
+  palette_init(&pal, 256);
+  double best = -1.0;
+  int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+  if (fd >= 0) {
+    best = time_backend(backend_ansi(&pal, fd, cfg->truecolor, 0), frames, rows, cols);
+    if (best >= 0.0) ch->backend = "ansi";
+    close(fd);
+  }
+  // ncurses has no truecolor, so it only competes without it.
+  FILE *devnull = cfg->truecolor ? NULL : fopen("/dev/null", "w");
+  SCREEN *scr = devnull ? newterm(NULL, devnull, stdin) : NULL;
+  if (scr) {
+    if (has_colors()) start_color();
+    resizeterm(rows, cols);
+    double s = time_backend(backend_ncurses(&pal, 0), frames, rows, cols);
+    endwin();
+    delscreen(scr);
+    if (s >= 0.0 && (best < 0.0 || s < best)) best = s, ch->backend = "ncurses";
+  }
+  if (devnull) fclose(devnull);
+  free(frames);
+  return best > 0.0 ? best : 0.0;
+}
+
+void autotune(const em_config *cfg, int rows, int cols, int what, TuneChoice *ch) {
+  ch->kernel = cfg->kernel;
+  ch->precision = cfg->precision;
+  ch->isa = cfg->isa;
+  ch->backend = NULL;
+  ch->cached = 0;
+  ch->frame_us = 0.0;
+  // Compact and event-driven runs fix the update path; only the ISA varies.
+  if (cfg->compact || cfg->events) what &= ~(TUNE_KERNEL | TUNE_PRECISION);
+
+  char key[256];
+  cache_key(cfg, rows, cols, what, key, sizeof(key));
+  if (cache_load(key, what, ch)) {
+    ch->cached = 1;
+    return;
+  }
+
+  // Kernels that keep the accuracy asked for: the balanced polynomials
+  // match exact, so they stand in for it unless exact was asked for.
+  struct { int kernel, precision; } kernels[4];
+  int nk = 0;
+  int prec = (what & TUNE_PRECISION) && cfg->precision == EM_PRECISION_EXACT
+                 ? EM_PRECISION_BALANCED : cfg->precision;
+  if (what & TUNE_KERNEL) {
+    kernels[nk].kernel = EM_KERNEL_EXPA, kernels[nk++].precision = cfg->precision;
+    if (prec != cfg->precision) kernels[nk].kernel = EM_KERNEL_EXPA, kernels[nk++].precision = prec;
+    kernels[nk].kernel = EM_KERNEL_LUT, kernels[nk++].precision = cfg->precision;
+    kernels[nk].kernel = EM_KERNEL_EIGEN, kernels[nk++].precision = cfg->precision;
+  } else {
+    kernels[nk].kernel = cfg->kernel, kernels[nk++].precision = cfg->precision;
+    if (prec != cfg->precision && cfg->kernel == EM_KERNEL_EXPA)
+      kernels[nk].kernel = EM_KERNEL_EXPA, kernels[nk++].precision = prec;
+  }
+  // Every instruction set the CPU has, or just the one given.
+  int isa_lo = EM_ISA_SSE2, isa_hi = EM_ISA_AVX512;
+  if (!(what & TUNE_ISA)) isa_lo = isa_hi = cfg->isa;
+
+  double best = -1.0;
+  for (int k = 0; k < nk; k++)
+    for (int isa = isa_lo; isa <= isa_hi; isa++) {
+      if (!em_isa_supported(isa)) continue;
+      em_config c = *cfg;
+      c.kernel = kernels[k].kernel;
+      c.precision = kernels[k].precision;
+      c.isa = isa;
+      double s = time_sim(&c, rows, cols);
+      if (s >= 0.0 && (best < 0.0 || s < best)) {
+        best = s;
+        ch->kernel = c.kernel;
+        ch->precision = c.precision;
+        ch->isa = isa;
+      }
+    }
+  if (best < 0.0) return;  // nothing ran; keep cfg's choices, don't cache
+
+  em_config c = *cfg;
+  c.kernel = ch->kernel;
+  c.precision = ch->precision;
+  c.isa = ch->isa;
+  double emit = (what & TUNE_BACKEND) ? tune_backends(&c, rows, cols, ch) : 0.0;
+  ch->frame_us = (best + emit) * 1e6;
+  cache_store(key, ch);
+}
+
+void autotune_report(const TuneChoice *ch, FILE *f) {
+  fprintf(f, "autotune: kernel %s, precision %s, isa %s", kernel_names[ch->kernel],
+          precision_names[ch->precision], isa_names[ch->isa]);
+  if (ch->backend) fprintf(f, ", backend %s", ch->backend);
+  if (ch->cached) fprintf(f, " (cached)\n");
+  else fprintf(f, " (%.0f us/frame)\n", ch->frame_us);
+}
@@ -0,0 +1,39 @@
+// Startup autotuner (--autotune).
+//
+// Times each update kernel / instruction set pair on the real particle
+// count and screen size for a few milliseconds, and each output backend on
+// frames from the simulation, then keeps the fastest. The result is cached
+// in $XDG_CACHE_HOME/ematrix/autotune (~/.cache/ematrix/autotune), one
+// line per CPU model, terminal type, option set, particle count and screen
+// size class, so later starts just read it back.
+
+#ifndef EMATRIX_AUTOTUNE_H
+#define EMATRIX_AUTOTUNE_H
+
+#include <stdio.h>
+
+#include "ematrix.h"
+
+typedef struct {
+  int kernel;          // EM_KERNEL_*
+  int precision;       // EM_PRECISION_*
+  int isa;             // EM_ISA_*
+  const char *backend; // "ncurses" or "ansi"; NULL when not tuned
+  int cached;          // came from the cache
+  double frame_us;     // measured update + compose + emit time (0 if cached)
+} TuneChoice;
+
+// What autotune() may choose; whatever the user gave is left out.
+enum { TUNE_KERNEL = 1, TUNE_PRECISION = 2, TUNE_ISA = 4, TUNE_BACKEND = 8 };
+
+// Tune for cfg (colors, truecolor, compact, events, particles and sort as
+// the run will use them) on a rows x cols screen, choosing only what the
+// TUNE_* bits in what allow; the rest of *ch is taken from cfg. Must run
+// before initscr(): the ncurses backend is timed on a private screen
+// writing to /dev/null.
+void autotune(const em_config *cfg, int rows, int cols, int what, TuneChoice *ch);
+
+// One line describing the choice, for the exit report.
+void autotune_report(const TuneChoice *ch, FILE *f);
+
+#endif
@@ -0,0 +1,428 @@
+// Microbenchmarks for the hot pieces of ematrix, one CSV row each.
+//
+//   make bench                 # or: bench/bench [cols rows]
+//
+// Every benchmark is run with a growing iteration count until it takes
+// long enough to time, then repeated and the best run reported as
+// ns/op and cycles/op. Cycles come from the TSC on x86 (reference
+// cycles, not core clocks) and are 0 elsewhere.
+
+#include <ncurses.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "ematrix.h"
+#include "kernels.h"
+#include "render.h"
+
+#define MIN_NS   20e6  // grow the iteration count until a run takes this long
+#define REPEATS  5
+
+static volatile float sink;
+
+static uint64_t cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// fn(arg, iters) runs iters iterations of ops_per_iter operations each.
+typedef void (*bench_fn)(void *arg, long iters);
+
+static void run(const char *name, bench_fn fn, void *arg, long ops_per_iter) {
+  long iters = 1;
+  for (;;) {
+    double t0 = now_ns();
+    fn(arg, iters);
+    if (now_ns() - t0 >= MIN_NS || iters >= (1L << 40)) break;
+    iters *= 2;
+  }
+  double best_ns = 1e300, best_cy = 1e300;
+  for (int r = 0; r < REPEATS; r++) {
+    double t0 = now_ns();
+    uint64_t c0 = cycles();
+    fn(arg, iters);
+    uint64_t c1 = cycles();
+    double t1 = now_ns();
+    if (t1 - t0 < best_ns) best_ns = t1 - t0, best_cy = (double)(c1 - c0);
+  }
+  double ops = (double)iters * (double)ops_per_iter;
+  printf("%s,%.0f,%.3f,%.2f\n", name, ops, best_ns / ops, best_cy / ops);
+  fflush(stdout);
+}
+
+// ---------------------------------------------------------------------------
+// expA variants
+
+#define NAGES 4096
+static float ages[NAGES];
+
+static void b_expa_scalar(void *arg, long iters) {
+  (void)arg;
+  float s = 0.0f, M[2][2];
+  for (long it = 0; it < iters; it++)
+    for (int i = 0; i < NAGES; i++) expA(ages[i], M), s += M[0][0] + M[1][0];
+  sink = s;
+}
+
+static void b_expa_lut(void *arg, long iters) {
+  (void)arg;
+  float s = 0.0f, M[2][2];
+  for (long it = 0; it < iters; it++)
+    for (int i = 0; i < NAGES; i++) expA_lut(ages[i], M), s += M[0][0] + M[1][0];
+  sink = s;
+}
+
+static void b_expa_fast(void *arg, long iters) {
+  (void)arg;
+  float s = 0.0f, M[2][2];
+  for (long it = 0; it < iters; it++)
+    for (int i = 0; i < NAGES; i++) expA_fast(ages[i], M), s += M[0][0] + M[1][0];
+  sink = s;
+}
+
+static void b_expa_balanced(void *arg, long iters) {
+  (void)arg;
+  float s = 0.0f, M[2][2];
+  for (long it = 0; it < iters; it++)
+    for (int i = 0; i < NAGES; i++) expA_balanced(ages[i], M), s += M[0][0] + M[1][0];
+  sink = s;
+}
+
+static void b_expa_incr(void *arg, long iters) {
+  (void)arg;
+  float E[2][2], M[2][2], s = 0.0f;
+  expA(1.35f / 200.0f, E);
+  for (long it = 0; it < iters; it++) {
+    expA(0.0f, M);
+    for (int i = 0; i < NAGES; i++) expA_advance(M, E), s += M[0][0] + M[1][0];
+  }
+  sink = s;
+}
+
+// ---------------------------------------------------------------------------
+// RNG variants
+
+static void b_rng_rand(void *arg, long iters) {
+  (void)arg;
+  unsigned s = 0;
+  for (long it = 0; it < iters; it++)
+    for (int i = 0; i < 4096; i++) s += (unsigned)rand();
+  sink = (float)s;
+}
+
+static void b_rng_xorshift(void *arg, long iters) {
+  (void)arg;
+  uint64_t st = 88172645463325252ULL;
+  uint32_t s = 0;
+  for (long it = 0; it < iters; it++)
+    for (int i = 0; i < 4096; i++) s += rng_next(&st);
+  sink = (float)s;
+}
+
+static void b_rng_counter(void *arg, long iters) {
+  (void)arg;
+  uint64_t s = 0, ctr = 0;
+  for (long it = 0; it < iters; it++)
+    for (int i = 0; i < 4096; i++) s += mix64(ctr++);
+  sink = (float)s;
+}
+
+// ---------------------------------------------------------------------------
+// mutate: the glyph mutation decision for one visible particle, rolled
+// every frame vs a skip counter that only draws when it runs out
+
+#define NMUT 4096
+static Particle mut_p[NMUT];
+
+static void b_mutate_roll(void *arg, long iters) {
+  (void)arg;
+  uint64_t st = 1;
+  for (long it = 0; it < iters; it++)
+    for (int i = 0; i < NMUT; i++)
+      if ((rng_next(&st) % MUTATE_ODDS) == 0) mut_p[i].ch = rand_char(&st);
+  sink = (float)mut_p[7].ch;
+}
+
+static void b_mutate_skip(void *arg, long iters) {
+  (void)arg;
+  for (long it = 0; it < iters; it++)
+    for (int i = 0; i < NMUT; i++) {
+      if (--mut_p[i].mutate) continue;
+      uint64_t h = ctr_rand(1, (uint32_t)i, (uint32_t)it);
+      mut_p[i].ch = glyph_set[(uint32_t)(h >> 32) % GLYPH_COUNT];
+      mut_p[i].mutate = (uint16_t)mutate_skip((uint32_t)h);
+    }
+  sink = (float)mut_p[7].ch;
+}
+
+// ---------------------------------------------------------------------------
+// respawn: one call per particle (as a scattered death would) vs one batch
+
+#define NSPAWN 4096
+static Particle spawn_p[NSPAWN];
+static int spawn_idx[NSPAWN];
+
+static void b_respawn_single(void *arg, long iters) {
+  (void)arg;
+  uint64_t st = 1;
+  for (long it = 0; it < iters; it++)
+    for (int i = 0; i < NSPAWN; i++) respawn_batch(spawn_p, &spawn_idx[i], 1, 60, 200, 0.0f, &st);
+  sink = spawn_p[7].vx0;
+}
+
+static void b_respawn_batch(void *arg, long iters) {
+  (void)arg;
+  uint64_t st = 1;
+  for (long it = 0; it < iters; it++)
+    respawn_batch(spawn_p, spawn_idx, NSPAWN, 60, 200, 0.0f, &st);
+  sink = spawn_p[7].vx0;
+}
+
+// ---------------------------------------------------------------------------
+// Simulation stages through the public API
+
+typedef struct {
+  em_ctx *sim;
+  double t;
+} SimArg;
+
+static void b_update(void *arg, long iters) {
+  SimArg *a = (SimArg *)arg;
+  for (long it = 0; it < iters; it++) em_update(a->sim, a->t += 1.0 / 200.0);
+}
+
+static void b_step(void *arg, long iters) {
+  SimArg *a = (SimArg *)arg;
+  for (long it = 0; it < iters; it++) em_step(a->sim, a->t += 1.0 / 200.0);
+}
+
+static void b_compose(void *arg, long iters) {
+  SimArg *a = (SimArg *)arg;
+  for (long it = 0; it < iters; it++) em_compose(a->sim);
+}
+
+// ---------------------------------------------------------------------------
+// Backends, fed a loop of pre-simulated frames through the presenter
+
+#define NFRAMES 64
+
+typedef struct {
+  Backend *be;
+  Screen screen;
+  const em_cell *frames;
+  int rows, cols;
+} BackendArg;
+
+static void b_backend(void *arg, long iters) {
+  BackendArg *a = (BackendArg *)arg;
+  size_t n = (size_t)a->rows * (size_t)a->cols;
+  for (long it = 0; it < iters; it++) {
+    const em_cell *f = a->frames + (size_t)(it % NFRAMES) * n;
+    a->be->begin_frame(a->be);
+    screen_present(&a->screen, a->be, f, -1);
+    a->be->end_frame(a->be);
+  }
+}
+
+// threads > 1 presents bands in parallel where the backend can.
+static void bench_backend(const char *name, Backend *be, const em_cell *frames,
+                          int rows, int cols, int threads) {
+  if (!be) {
+    fprintf(stderr, "bench: skipping %s (backend unavailable)\n", name);
+    return;
+  }
+  BackendArg a = {be, {0}, frames, rows, cols};
+  screen_resize(&a.screen, rows, cols);
+  a.screen.workers = threads > 1 ? workers_create(threads) : NULL;
+  be->resize(be, rows, cols);
+  run(name, b_backend, &a, 1);
+  workers_destroy(a.screen.workers);
+  screen_free(&a.screen);
+  be->destroy(be);
+}
+
+int main(int argc, char **argv) {
+  int cols = argc > 2 ? atoi(argv[1]) : 200;
+  int rows = argc > 2 ? atoi(argv[2]) : 60;
+  if (rows <= 0 || cols <= 0) {
+    fprintf(stderr, "usage: %s [cols rows]\n", argv[0]);
+    return 2;
+  }
+
+  srand(1);
+  for (int i = 0; i < NAGES; i++) ages[i] = 12.0f * (float)i / (float)NAGES;
+  for (int i = 0; i < NSPAWN; i++) spawn_idx[i] = i;
+  for (int i = 0; i < NMUT; i++) mut_p[i].mutate = (uint16_t)mutate_skip((uint32_t)mix64(i));
+  expA_lut_init();
+
+  printf("bench,ops,ns_per_op,cycles_per_op\n");
+
+  run("expA/scalar", b_expa_scalar, NULL, NAGES);
+  run("expA/lut", b_expa_lut, NULL, NAGES);
+  run("expA/fast", b_expa_fast, NULL, NAGES);
+  run("expA/balanced", b_expa_balanced, NULL, NAGES);
+  run("expA/incremental", b_expa_incr, NULL, NAGES);
+
+  run("rng/rand", b_rng_rand, NULL, 4096);
+  run("rng/xorshift64s", b_rng_xorshift, NULL, 4096);
+  run("rng/counter_mix64", b_rng_counter, NULL, 4096);
+  run("mutate/roll", b_mutate_roll, NULL, NMUT);
+  run("mutate/skip", b_mutate_skip, NULL, NMUT);
+
+  run("respawn/single", b_respawn_single, NULL, NSPAWN);
+  run("respawn/batch", b_respawn_batch, NULL, NSPAWN);
+
+  // Per-particle cost of each stage on a rows x cols screen.
+  em_config cfg;
+  em_config_default(&cfg);
+  cfg.seed = 1;
+  cfg.particles = rows * cols / 20 > 200 ? rows * cols / 20 : 200;
+  cfg.truecolor = 1;
+  SimArg sa = {em_create(&cfg, rows, cols), 0.0};
+  if (!sa.sim) return 1;
+  for (int i = 0; i < 400; i++) em_step(sa.sim, sa.t += 1.0 / 200.0); // reach steady state
+  run("update", b_update, &sa, cfg.particles);
+  for (int k = EM_KERNEL_LUT; k <= EM_KERNEL_EIGEN; k++) {
+    em_config kc = cfg;
+    kc.kernel = k;
+    SimArg ka = {em_create(&kc, rows, cols), 0.0};
+    if (!ka.sim) return 1;
+    for (int i = 0; i < 400; i++) em_update(ka.sim, ka.t += 1.0 / 200.0);
+    run(k == EM_KERNEL_LUT ? "update/lut" : "update/eigen", b_update, &ka, kc.particles);
+    em_destroy(ka.sim);
+  }
+  {
+    // Event-driven: only particles that may have changed cell are touched.
+    em_config ec = cfg;
+    ec.events = 1;
+    SimArg ea = {em_create(&ec, rows, cols), 0.0};
+    if (!ea.sim) return 1;
+    for (int i = 0; i < 400; i++) em_update(ea.sim, ea.t += 1.0 / 200.0);
+    run("update/events", b_update, &ea, ec.particles);
+    em_destroy(ea.sim);
+  }
+  em_set_mode(sa.sim, 0);
+  run("compose/green", b_compose, &sa, cfg.particles);
+  em_set_mode(sa.sim, 1);
+  run("compose/bh", b_compose, &sa, cfg.particles);
+
+  // The SIMD kernels per instruction set: eigen and polynomial updates
+  // (positions + binning) and the bh-mode compose.
+  static const char *isa_name[] = {"auto", "sse2", "avx2", "avx512"};
+  for (int isa = EM_ISA_SSE2; isa <= EM_ISA_AVX512; isa++) {
+    if (!em_isa_supported(isa)) {
+      fprintf(stderr, "bench: skipping %s (not supported here)\n", isa_name[isa]);
+      continue;
+    }
+    char name[64];
+    em_config ic = cfg;
+    ic.isa = isa;
+    for (int v = 0; v < 2; v++) {
+      ic.kernel = v ? EM_KERNEL_EXPA : EM_KERNEL_EIGEN;
+      ic.precision = v ? EM_PRECISION_FAST : EM_PRECISION_EXACT;
+      SimArg ia = {em_create(&ic, rows, cols), 0.0};
+      if (!ia.sim) return 1;
+      for (int i = 0; i < 400; i++) em_update(ia.sim, ia.t += 1.0 / 200.0);
+      snprintf(name, sizeof(name), "update/%s/%s", v ? "fast" : "eigen", isa_name[isa]);
+      run(name, b_update, &ia, ic.particles);
+      if (v) {
+        em_set_mode(ia.sim, 1);
+        snprintf(name, sizeof(name), "compose/bh/%s", isa_name[isa]);
+        run(name, b_compose, &ia, ic.particles);
+      }
+      em_destroy(ia.sim);
+    }
+  }
+
+  // Past the L2 cache: a million particles, 16-byte vs 8-byte encoding.
+  for (int compact = 0; compact <= 1; compact++) {
+    em_config big = cfg;
+    big.particles = 1 << 20;
+    big.compact = compact;
+    SimArg ba = {em_create(&big, rows, cols), 0.0};
+    if (!ba.sim) return 1;
+    for (int i = 0; i < 20; i++) em_update(ba.sim, ba.t += 1.0 / 200.0);
+    run(compact ? "update/1M_compact" : "update/1M", b_update, &ba, big.particles);
+    em_destroy(ba.sim);
+  }
+
+  // A 4K-class terminal, whose cell frame is far past L2: particles in
+  // spawn order write all over it, sorted by tile they sweep it.
+  for (int sorted = 0; sorted <= 1; sorted++) {
+    em_config lc = cfg;
+    lc.particles = 0;
+    lc.sort = sorted;
+    SimArg la = {em_create(&lc, 480, 1600), 0.0};
+    if (!la.sim) return 1;
+    for (int i = 0; i < 400; i++) em_step(la.sim, la.t += 1.0 / 200.0);
+    em_stats st;
+    em_get_stats(la.sim, &st);
+    run(sorted ? "step/1600x480_sorted" : "step/1600x480", b_step, &la, st.particles);
+    em_set_mode(la.sim, 1);
+    em_update(la.sim, la.t += 1.0 / 200.0);
+    run(sorted ? "compose/1600x480_sorted" : "compose/1600x480", b_compose, &la, st.particles);
+    em_destroy(la.sim);
+  }
+  {
+    // The same frame split over threads, by particle slice and screen band.
+    em_config tc = cfg;
+    tc.particles = 0;
+    tc.threads = 4;
+    SimArg ta = {em_create(&tc, 480, 1600), 0.0};
+    if (!ta.sim) return 1;
+    for (int i = 0; i < 400; i++) em_step(ta.sim, ta.t += 1.0 / 200.0);
+    em_stats st;
+    em_get_stats(ta.sim, &st);
+    run("step/1600x480_threads4", b_step, &ta, st.particles);
+    em_destroy(ta.sim);
+  }
+
+  // A loop of bh-mode frames (the busiest look) for the backends.
+  size_t n = (size_t)rows * (size_t)cols;
+  em_cell *frames = (em_cell *)malloc(NFRAMES * n * sizeof(em_cell));
+  if (!frames) return 1;
+  for (int f = 0; f < NFRAMES; f++) {
+    em_step(sa.sim, sa.t += 1.0 / 200.0);
+    memcpy(frames + (size_t)f * n, em_cells(sa.sim, NULL, NULL), n * sizeof(em_cell));
+  }
+  em_destroy(sa.sim);
+
+  Palette pal;
+  palette_init(&pal, 256);
+  bench_backend("backend/null", backend_null(), frames, rows, cols, 1);
+  bench_backend("backend/ansi", backend_ansi(&pal, -1, 0, 0), frames, rows, cols, 1);
+  bench_backend("backend/ansi_truecolor", backend_ansi(&pal, -1, 1, 0), frames, rows, cols, 1);
+  bench_backend("backend/ansi_truecolor_threads4", backend_ansi(&pal, -1, 1, 0), frames, rows, cols, 4);
+  bench_backend("backend/recorder", backend_recorder("/dev/null"), frames, rows, cols, 1);
+
+  // ncurses renders into a private screen whose output goes to /dev/null.
+  FILE *devnull = fopen("/dev/null", "w");
+  SCREEN *scr = devnull ? newterm("xterm-256color", devnull, stdin) : NULL;
+  if (scr) {
+    resizeterm(rows, cols);
+    bench_backend("backend/ncurses", backend_ncurses(&pal, 0), frames, rows, cols, 1);
+    endwin();
+    delscreen(scr);
+  } else {
+    bench_backend("backend/ncurses", NULL, frames, rows, cols, 1);
+  }
+  if (devnull) fclose(devnull);
+
+  free(frames);
+  return 0;
+}
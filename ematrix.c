@@ -1,5 +1,43 @@
-// Build: gcc -O2 -Wall -Wextra ematrix.c -lncurses -lm -o ematrix
-// Keys: q to quit
+// Build: make (links libematrix.a, the simulation, with the render backends)
+// Keys: q to quit, r toggles the black-hole look, h the performance HUD
+// Options:
+//   --max-bytes-per-frame N   cap the estimated terminal output per frame
+//   --max-kbps K              cap the estimated terminal output rate
+//   --truecolor               emit 24-bit color directly instead of via ncurses
+//   --sync                    wrap frames in DEC 2026 synchronized output
+//   --backend NAME            ncurses (default), ansi, or null
+//   --record FILE             record every frame's cell changes to FILE
+//   --perf-counters           count cycles, instructions, cache and branch
+//                             misses per frame stage; report at exit
+//   --trace FILE              write frame phases to FILE as Chrome trace JSON
+//   --compact                 store particles in 8 bytes (quantized polar)
+//   --particles N             particle count (default: rows * cols / 20)
+//   --kernel NAME             particle update: expa (default), lut or eigen
+//   --events                  in green mode only recompute particles that may
+//                             have changed cell (implies --kernel eigen)
+//   --precision LEVEL         exp/sin/cos for --kernel expa: exact (libm,
+//                             default), balanced or fast (polynomials)
+//   --isa NAME                SIMD kernels: auto (default: the widest this
+//                             CPU has), sse2, avx2 or avx512
+//   --sort                    keep particles in screen tile order (faster
+//                             cell writes on big terminals)
+//   --threads N               update, compose and (ansi backend) encode on
+//                             N threads; same frames as one
+//   --autotune                time the kernels, instruction sets and
+//                             backends not given explicitly and use the
+//                             fastest; cached in ~/.cache/ematrix
+//   --wall-host NAME          run a video wall's shared simulation headless
+//                             (with --wall-size COLSxROWS, default 400x100,
+//                             and --wall-shards N, default 4)
+//   --wall NAME               render a shard of wall NAME and a viewport of
+//                             it at --wall-at X,Y (default 0,0)
+//   --serve ADDR              broadcast to viewers on a Unix socket path or
+//                             [HOST]:PORT (telnet; no host is loopback,
+//                             an IPv6 host is bracketed: [::1]:2323)
+//                             instead of drawing here, resampled from
+//                             --serve-size COLSxROWS (default 240x80)
+//   --publish NAME            publish every cell frame to other processes in
+//                             /dev/shm/ematrix-frames-NAME (see publish.h)
 
 #include <ncurses.h>
 #include <math.h>
@@ -7,66 +45,250 @@
 #include <time.h>
 #include <unistd.h>
 #include <string.h>
-
-typedef struct {
-  float vx0, vy0;     // initial vector (relative to center)
-  float born;         // birth time (seconds)
-  char  ch;           // character to draw
-} Particle;
-
-static float frandf(float a, float b) {
-  return a + (b - a) * (float)rand() / (float)RAND_MAX;
-}
-
-static char rand_char(void) {
-  static const char *set =
-      "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz@#$%&*+=-";
-  return set[rand() %  (int)strlen(set)];
+#include <stdio.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+#include "autotune.h"
+#include "ematrix.h"
+#include "hud.h"
+#include "perfctr.h"
+#include "publish.h"
+#include "render.h"
+#include "serve.h"
+#include "trace.h"
+#include "wall.h"
+
+// The frame period: 200 fps, which the look (glyph mutation odds, fades)
+// is tuned for. The server and a wall's host pace their frames with it too.
+#define FRAME_US 5000
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
 }
 
-// Analytic matrix exponential for A = [[-1,-1],[1,0]].
-// exp(A t) = e^{-0.5 t} [ cos(w t) I + (sin(w t)/w) (A + 0.5 I) ]
-// where w = sqrt(3)/2 ≈ 0.8660254
-static void expA(float t, float M[2][2]) {
-  const float w = 0.8660254037844386f; // sqrt(3)/2
-  float et = expf(-0.5f * t);
-  float c  = cosf(w * t);
-  float s  = sinf(w * t);
-  float k  = (fabsf(w) < 1e-8f) ? t : (s / w);
-
-  // B = A + 0.5 I = [[-0.5, -1],[1, 0.5]]
-  float B00 = -0.5f, B01 = -1.0f, B10 = 1.0f, B11 = 0.5f;
-
-  // M = et * ( c*I + k*B )
-  M[0][0] = et * (c + k * B00);
-  M[0][1] = et * (    k * B01);
-  M[1][0] = et * (    k * B10);
-  M[1][1] = et * (c + k * B11);
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--max-bytes-per-frame N] [--max-kbps K] [--truecolor] [--sync]\n"
+          "       [--backend ncurses|ansi|null] [--record FILE] [--perf-counters]\n"
+          "       [--trace FILE] [--compact] [--particles N]\n"
+          "       [--kernel expa|lut|eigen] [--events]\n"
+          "       [--precision exact|balanced|fast] [--isa auto|sse2|avx2|avx512]\n"
+          "       [--sort] [--threads N] [--autotune]\n"
+          "       [--wall-host NAME [--wall-size COLSxROWS] [--wall-shards N]]\n"
+          "       [--wall NAME [--wall-at X,Y]]\n"
+          "       [--serve PATH|HOST:PORT|[IPV6]:PORT [--serve-size COLSxROWS]]\n"
+          "       [--publish NAME]\n",
+          argv0);
+  exit(2);
 }
 
-static float now_seconds(void) {
-  struct timespec ts;
-  clock_gettime(CLOCK_MONOTONIC, &ts);
-  return (float)ts.tv_sec + (float)ts.tv_nsec * 1e-9f;
-}
+int main(int argc, char **argv) {
+  long max_bytes_frame = -1; // < 0: unlimited
+  long max_kbps = -1;
+  int truecolor = 0;
+  int sync = 0;
+  const char *backend_name = NULL;
+  const char *record_path = NULL;
+  int perf_counters = 0;
+  const char *trace_path = NULL;
+  int compact = 0;
+  int particles = 0;
+  int kernel = EM_KERNEL_EXPA;
+  int events = 0;
+  int precision = EM_PRECISION_EXACT;
+  int isa = EM_ISA_AUTO;
+  int sort = 0;
+  int threads = 1;
+  int tune = 0, kernel_given = 0, precision_given = 0, isa_given = 0;
+  const char *wall_host_name = NULL, *wall_name = NULL, *serve_addr = NULL;
+  const char *publish_name = NULL;
+  int wall_cols = 400, wall_rows = 100, wall_shards = 4, wall_x = 0, wall_y = 0;
+  int serve_cols = 240, serve_rows = 80;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--max-bytes-per-frame") && i + 1 < argc) {
+      max_bytes_frame = atol(argv[++i]);
+      if (max_bytes_frame <= 0) usage(argv[0]);
+    } else if (!strcmp(argv[i], "--truecolor")) {
+      truecolor = 1;
+    } else if (!strcmp(argv[i], "--sync")) {
+      sync = 1;
+    } else if (!strcmp(argv[i], "--backend") && i + 1 < argc) {
+      backend_name = argv[++i];
+    } else if (!strcmp(argv[i], "--record") && i + 1 < argc) {
+      record_path = argv[++i];
+    } else if (!strcmp(argv[i], "--perf-counters")) {
+      perf_counters = 1;
+    } else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+      trace_path = argv[++i];
+    } else if (!strcmp(argv[i], "--compact")) {
+      compact = 1;
+    } else if (!strcmp(argv[i], "--particles") && i + 1 < argc) {
+      particles = atoi(argv[++i]);
+      if (particles <= 0) usage(argv[0]);
+    } else if (!strcmp(argv[i], "--kernel") && i + 1 < argc) {
+      const char *k = argv[++i];
+      if (!strcmp(k, "expa"))       kernel = EM_KERNEL_EXPA;
+      else if (!strcmp(k, "lut"))   kernel = EM_KERNEL_LUT;
+      else if (!strcmp(k, "eigen")) kernel = EM_KERNEL_EIGEN;
+      else usage(argv[0]);
+      kernel_given = 1;
+    } else if (!strcmp(argv[i], "--events")) {
+      events = 1;
+    } else if (!strcmp(argv[i], "--precision") && i + 1 < argc) {
+      const char *p = argv[++i];
+      if (!strcmp(p, "exact"))         precision = EM_PRECISION_EXACT;
+      else if (!strcmp(p, "balanced")) precision = EM_PRECISION_BALANCED;
+      else if (!strcmp(p, "fast"))     precision = EM_PRECISION_FAST;
+      else usage(argv[0]);
+      precision_given = 1;
+    } else if (!strcmp(argv[i], "--isa") && i + 1 < argc) {
+      const char *s = argv[++i];
+      for (isa = EM_ISA_AVX512; isa >= EM_ISA_AUTO && strcmp(s, hud_isa_name(isa)); isa--) {}
+      if (isa < EM_ISA_AUTO) usage(argv[0]);
+      isa_given = 1;
+    } else if (!strcmp(argv[i], "--sort")) {
+      sort = 1;
+    } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+      if (threads <= 0) usage(argv[0]);
+    } else if (!strcmp(argv[i], "--autotune")) {
+      tune = 1;
+    } else if (!strcmp(argv[i], "--wall-host") && i + 1 < argc) {
+      wall_host_name = argv[++i];
+    } else if (!strcmp(argv[i], "--wall-size") && i + 1 < argc) {
+      if (sscanf(argv[++i], "%dx%d", &wall_cols, &wall_rows) != 2 ||
+          wall_cols <= 0 || wall_rows <= 0)
+        usage(argv[0]);
+    } else if (!strcmp(argv[i], "--wall-shards") && i + 1 < argc) {
+      wall_shards = atoi(argv[++i]);
+      if (wall_shards <= 0) usage(argv[0]);
+    } else if (!strcmp(argv[i], "--wall") && i + 1 < argc) {
+      wall_name = argv[++i];
+    } else if (!strcmp(argv[i], "--wall-at") && i + 1 < argc) {
+      if (sscanf(argv[++i], "%d,%d", &wall_x, &wall_y) != 2) usage(argv[0]);
+    } else if (!strcmp(argv[i], "--serve") && i + 1 < argc) {
+      serve_addr = argv[++i];
+    } else if (!strcmp(argv[i], "--publish") && i + 1 < argc) {
+      publish_name = argv[++i];
+    } else if (!strcmp(argv[i], "--serve-size") && i + 1 < argc) {
+      if (sscanf(argv[++i], "%dx%d", &serve_cols, &serve_rows) != 2 ||
+          serve_cols <= 0 || serve_rows <= 0)
+        usage(argv[0]);
+    } else if (!strcmp(argv[i], "--max-kbps") && i + 1 < argc) {
+      max_kbps = atol(argv[++i]);
+      if (max_kbps <= 0) usage(argv[0]);
+    } else {
+      usage(argv[0]);
+    }
+  }
 
-static void respawn(Particle *p, int cols, int rows) {
-  // Spawn somewhere in a ring around the center
-  float cx = (cols - 1) * 0.5f;
-  float cy = (rows - 1) * 0.5f;
+  if (!em_isa_supported(isa)) {
+    fprintf(stderr, "ematrix: this CPU can't run --isa %s\n", hud_isa_name(isa));
+    return 1;
+  }
+  if (!!wall_host_name + !!wall_name + !!serve_addr > 1) usage(argv[0]);
+  if (publish_name && (wall_host_name || serve_addr)) usage(argv[0]);
+
+  // The server draws only for its viewers, in 256 colors or truecolor.
+  if (serve_addr) {
+    Palette spal;
+    palette_init(&spal, 256);
+    em_config sc;
+    em_config_default(&sc);
+    sc.truecolor = truecolor;
+    sc.compact = compact;
+    sc.particles = particles;
+    sc.kernel = kernel;
+    sc.events = events;
+    sc.precision = precision;
+    sc.isa = isa;
+    sc.sort = sort;
+    sc.threads = threads;
+    sc.bh_pair_base = spal.bh_base;
+    sc.bh_pair_count = spal.bh_count;
+    return serve(serve_addr, &sc, &spal, truecolor, serve_rows, serve_cols, FRAME_US);
+  }
 
-  float maxr = fminf(cx, cy);
-  float r = frandf(maxr * 0.35f, maxr * 2.95f);
-  float a = frandf(0.0f, 2.0f * (float)M_PI);
+  // The wall host has no terminal of its own: it only simulates.
+  if (wall_host_name) {
+    em_config hc;
+    em_config_default(&hc);
+    hc.compact = compact;
+    hc.particles = particles;
+    hc.kernel = kernel;
+    hc.precision = precision;
+    hc.isa = isa;
+    return wall_host(wall_host_name, &hc, wall_rows, wall_cols, wall_shards, FRAME_US);
+  }
+  // Claimed before initscr so a failure message lands on a sane terminal.
+  Wall *wall = wall_name ? wall_join(wall_name) : NULL;
+  if (wall_name && !wall) return 1;
+
+  // Before initscr: the tuner runs ncurses on a screen of its own. An
+  // explicit --kernel, --precision, --isa or --backend is left alone.
+  TuneChoice tuned = {0};
+  if (tune) {
+    struct winsize ws;
+    int trows = 24, tcols = 80;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0 && ws.ws_col > 0)
+      trows = ws.ws_row, tcols = ws.ws_col;
+    em_config tc;
+    em_config_default(&tc);
+    tc.truecolor = truecolor;
+    tc.compact = compact;
+    tc.particles = particles;
+    tc.kernel = kernel;
+    tc.events = events;
+    tc.precision = precision;
+    tc.isa = isa;
+    tc.sort = sort;
+    autotune(&tc, trows, tcols,
+             (kernel_given ? 0 : TUNE_KERNEL) | (precision_given ? 0 : TUNE_PRECISION) |
+                 (isa_given ? 0 : TUNE_ISA) | (backend_name || record_path ? 0 : TUNE_BACKEND),
+             &tuned);
+    kernel = tuned.kernel;
+    precision = tuned.precision;
+    isa = tuned.isa;
+    if (tuned.backend) backend_name = tuned.backend;
+  }
 
-  p->vx0 = r * cosf(a);
-  p->vy0 = r * sinf(a);
-  p->born = now_seconds();
-  p->ch = rand_char();
-}
+  // Opened before initscr so a failure message lands on a sane terminal.
+  // The counters follow the threads started after them (the worker pool)
+  // but not the trace flusher.
+  if (trace_path && trace_open(trace_path) < 0) {
+    fprintf(stderr, "ematrix: can't write trace %s: %s\n", trace_path, strerror(errno));
+    return 1;
+  }
+  trace_thread_name("main");
+  PerfCounters *pc = perf_counters ? perfctr_open() : NULL;
+  Publisher *pub = NULL;
+  if (publish_name) {
+    struct winsize ws;
+    int prows = 24, pcols = 80;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0 && ws.ws_col > 0)
+      prows = ws.ws_row, pcols = ws.ws_col;
+    if (!(pub = publish_open(publish_name, prows, pcols))) return 1;
+  }
 
-int main(void) {
-  srand((unsigned)time(NULL));
+  // Resize and termination arrive through a signalfd, so block them before
+  // ncurses gets a chance to install handlers of its own.
+  sigset_t sigs;
+  sigemptyset(&sigs);
+  sigaddset(&sigs, SIGWINCH);
+  sigaddset(&sigs, SIGTERM);
+  sigaddset(&sigs, SIGINT);
+  sigaddset(&sigs, SIGHUP);
+  sigprocmask(SIG_BLOCK, &sigs, NULL);
 
   initscr();
   noecho();
@@ -75,205 +297,210 @@ int main(void) {
   nodelay(stdscr, TRUE);
   timeout(0);
 
-  if (has_colors()) {
-    start_color();
-    use_default_colors();
-    init_pair(1, COLOR_GREEN, -1);
-    init_pair(2, COLOR_GREEN, -1);
-    init_pair(3, COLOR_GREEN, -1);
-    // "Black hole" rainbow palette (fg on black bg)
-    // If the terminal supports 256 colors, use bright extended palette indices.
-    if (COLORS >= 256) {
-      // blue, cyan, green, yellow, orange, red, magenta, purple, white
-      short pal[] = {21, 51, 46, 226, 202, 196, 201, 93, 231};
-      for (int i = 0; i < 9; i++) init_pair((short)(20 + i), pal[i], COLOR_BLACK);
-    } else {
-      // fallback: basic colors (still rainbow-ish)
-      short pal[] = {COLOR_BLUE, COLOR_CYAN, COLOR_GREEN, COLOR_YELLOW, COLOR_RED, COLOR_MAGENTA, COLOR_WHITE};
-      for (int i = 0; i < 7; i++) init_pair((short)(10 + i), pal[i], COLOR_BLACK);
-    }
+  if (!backend_name) backend_name = record_path ? "recorder" : truecolor ? "ansi" : "ncurses";
+  int use_ncurses = !record_path && !strcmp(backend_name, "ncurses");
+
+  // Truecolor bypasses the pair table entirely, so it colors even when
+  // terminfo claims fewer colors than the terminal really has.
+  int colors = has_colors() || truecolor;
+  int ncolors = has_colors() ? tigetnum("colors") : 0;
+  Palette pal;
+  palette_init(&pal, (truecolor && !use_ncurses) ? 256 : ncolors);
+
+  Backend *be = NULL;
+  if (record_path)                          be = backend_recorder(record_path);
+  else if (!strcmp(backend_name, "ncurses")) be = backend_ncurses(&pal, sync);
+  else if (!strcmp(backend_name, "ansi"))    be = backend_ansi(&pal, STDOUT_FILENO, truecolor, sync);
+  else if (!strcmp(backend_name, "null"))    be = backend_null();
+  if (!be) {
+    endwin();
+    fprintf(stderr, "ematrix: can't set up backend %s\n", record_path ? record_path : backend_name);
+    return 1;
   }
+  if (strcmp(be->name, "ncurses")) refresh(); // let ncurses do its initial clear before we draw
 
   int rows, cols;
   getmaxyx(stdscr, rows, cols);
 
-  // Particle count: tweak for density
-  int N = (rows * cols) / 20;
-  if (N < 200) N = 200;
-  Particle *P = (Particle *)calloc((size_t)N, sizeof(Particle));
-  if (!P) endwin(), exit(1);
-
-  for (int i = 0; i < N; i++) respawn(&P[i], cols, rows);
-
-  const float SCALE = 0.76f;     // matches your equation (· 0.76)
-  const float RADIUS_MULT = 2.0f; // increase/decrease overall swirl radius
-  const float X_MULT = 2.0f;       // horizontal stretch (increase for more left/right motion)
-  const float Y_MULT = 1.0f;       // vertical stretch
-  const float SPEED = 1.35f;     // tweak swirl speed
-  const float MIN_R = 3.0f;      // respawn when near center
-  const int   FPS_US = 3280;    // 200 fps
-
-  // Black-hole palette layout (depends on terminal color support)
-  const int BH_PAIR_BASE  = (has_colors() && COLORS >= 256) ? 20 : 10;
-  const int BH_PAIR_COUNT = (has_colors() && COLORS >= 256) ? 9 : 7;
-
-  int bh_mode = 0; // toggled with 'R' : black-hole-like palette using velocity + radius
-
-  while (1) {
-    int ch = getch();
-    if (ch == 'q' || ch == 'Q') break;
-    if (ch == 'r' || ch == 'R') bh_mode = !bh_mode;
+  em_config cfg;
+  em_config_default(&cfg);
+  cfg.colors = colors;
+  cfg.truecolor = truecolor;
+  cfg.compact = compact;
+  cfg.particles = particles;
+  cfg.kernel = kernel;
+  cfg.events = events;
+  cfg.precision = precision;
+  cfg.isa = isa;
+  cfg.sort = sort;
+  cfg.threads = threads;
+  cfg.bh_pair_base = pal.bh_base;
+  cfg.bh_pair_count = pal.bh_count;
+  // One pool for the simulation and the presenter; they take turns.
+  Workers *pool = threads > 1 ? workers_create(threads) : NULL;
+  if (trace_path) workers_trace(pool, trace_event, trace_thread_name);
+  cfg.workers = pool;
+  em_ctx *sim = wall ? wall_attach(wall, &cfg, wall_y, wall_x, rows, cols)
+                     : em_create(&cfg, rows, cols);
+  if (!sim) endwin(), exit(1);
+
+  // What the backend currently shows; resized along with the simulation.
+  Screen screen = {0};
+  screen.workers = pool;
+  Hud hud = {0};
+  int started = 0;
+
+  // Bandwidth limiter: a fixed per-frame budget, or a token bucket refilled
+  // at max_kbps and allowed to burst up to 50 ms worth of output.
+  double tokens = 0.0;
+  double tlast = now_seconds();
+
+  // Event loop: a timerfd paces frames, a signalfd reports resize and
+  // termination, and stdin wakes us for keys. Nothing runs between events.
+  int ep  = epoll_create1(EPOLL_CLOEXEC);
+  int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  int sfd = signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (ep < 0 || tfd < 0 || sfd < 0) endwin(), perror("ematrix: event setup"), exit(1);
+
+  // A wall's renderers go at the host's pace instead.
+  struct itimerspec its = {{0, FRAME_US * 1000L}, {0, FRAME_US * 1000L}};
+  if (!wall) timerfd_settime(tfd, 0, &its, NULL);
+
+  struct epoll_event ev = {0};
+  ev.events = EPOLLIN;
+  ev.data.fd = tfd;          epoll_ctl(ep, EPOLL_CTL_ADD, tfd, &ev);
+  ev.data.fd = sfd;          epoll_ctl(ep, EPOLL_CTL_ADD, sfd, &ev);
+  ev.data.fd = STDIN_FILENO; epoll_ctl(ep, EPOLL_CTL_ADD, STDIN_FILENO, &ev);
+
+  int quit = 0, wall_gone = 0;
+  double wall_t = 0.0;
+  while (!quit) {
+    // A wall renderer only polls here; it waits for the host's frames below.
+    struct epoll_event evs[4];
+    int nev = epoll_wait(ep, evs, 4, wall ? 0 : -1);
+    if (nev < 0 && errno != EINTR) break;
+
+    int tick = 0, resized = 0;
+    for (int e = 0; e < nev; e++) {
+      int fd = evs[e].data.fd;
+      if (fd == tfd) {
+        uint64_t expirations;
+        if (read(tfd, &expirations, sizeof(expirations)) > 0) tick = 1;
+      } else if (fd == sfd) {
+        struct signalfd_siginfo si;
+        while (read(sfd, &si, sizeof(si)) == (ssize_t)sizeof(si)) {
+          if (si.ssi_signo == SIGWINCH) {
+            struct winsize ws;
+            if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row && ws.ws_col)
+              resizeterm(ws.ws_row, ws.ws_col);
+            resized = 1;
+          } else {
+            quit = 1;
+          }
+        }
+      } else {
+        int ch;
+        while ((ch = getch()) != ERR) {
+          if (ch == 'q' || ch == 'Q') quit = 1;
+          if (ch == 'r' || ch == 'R') em_set_mode(sim, !em_mode(sim));
+          if (ch == 'h' || ch == 'H') hud.on = !hud.on;
+        }
+      }
+    }
+    if (quit) break;
+    if (wall) {
+      tick = wall_next_frame(wall, 20, &wall_t);
+      if (tick < 0) {
+        wall_gone = 1;
+        break;
+      }
+    }
+    // Resizes are drawn right away rather than waiting for the next tick,
+    // except on a wall, whose draws are only stable during a frame.
+    if (!tick && (wall || (!resized && started))) continue;
 
     // Handle terminal resize
     int newr, newc;
     getmaxyx(stdscr, newr, newc);
-    if (newr != rows || newc != cols) {
+    if (newr != rows || newc != cols || !started) {
       rows = newr; cols = newc;
-      clear();
-      for (int i = 0; i < N; i++) respawn(&P[i], cols, rows);
+      be->resize(be, rows, cols);
+      if (em_resize(sim, rows, cols) < 0 || screen_resize(&screen, rows, cols) < 0 ||
+          hud_resize(&hud, rows, cols) < 0)
+        endwin(), exit(1);
+      started = 1;
     }
 
-    float cx = (cols - 1) * 0.5f;
-    float cy = (rows - 1) * 0.5f;
-    // Max visible radius in the *un-stretched* (vx,vy) space
-    float maxr_vis = fminf(cx / X_MULT, cy / Y_MULT);
-
-    // Clear each frame (simple "cmatrix-like" refresh)
-    erase();
-
-    float tnow = now_seconds();
-
-    for (int i = 0; i < N; i++) {
-      float age = (tnow - P[i].born) * SPEED;
-      float M[2][2];
-      expA(age, M);
-
-      float vx = RADIUS_MULT * SCALE * (M[0][0] * P[i].vx0 + M[0][1] * P[i].vy0);
-      float vy = RADIUS_MULT * SCALE * (M[1][0] * P[i].vx0 + M[1][1] * P[i].vy0);
-      float sx = X_MULT * vx;
-      float sy = Y_MULT * vy;
-      float r = sqrtf(vx * vx + vy * vy);
-      int x = (int)lroundf(cx + sx);
-      int y = (int)lroundf(cy + sy);
-
-      // Respawn if too close to center or off-screen
-      if (r < MIN_R || x < 0 || x >= cols || y < 0 || y >= rows) {
-        respawn(&P[i], cols, rows);
-        continue;
-      }
-
-      // Occasionally mutate character for that "matrix" vibe
-      if ((rand() % 28) == 0) P[i].ch = rand_char();
-
-      // Color/brightness
-      if (has_colors()) {
-        if (!bh_mode) {
-          // Original "matrix green" vibe
-          float a = fminf(age / 2.0f, 1.0f);
-          attron(COLOR_PAIR(1));
-          if (a > 0.66f) attron(A_BOLD);
-          mvaddch(y, x, P[i].ch);
-          if (a > 0.66f) attroff(A_BOLD);
-          attroff(COLOR_PAIR(1));
-        } else {
-          // "Black hole" vibe: use BOTH radius and local speed (velocity) for color
-          // Position in (vx,vy) space (pre-stretch)
-          float shadow_r = 0.18f * maxr_vis;
-          float ring_r   = 0.32f * maxr_vis;
-          float ring_w   = 0.06f * maxr_vis;
-
-          // Velocity w.r.t. real time: v_dot = SPEED * A * v
-          float ax = -vx - vy; // A*[vx;vy] x-component
-          float ay =  vx;      // A*[vx;vy] y-component
-          float speed = SPEED * sqrtf(ax * ax + ay * ay);
-
-          // "Swirl" ~ angular-ish speed (varies with direction, not just radius)
-          float swirl = speed / (r + 1e-3f);
-          float swirl_n = fminf(swirl / 2.0f, 1.0f);
-
-          // Heat: roughly how fast it's moving relative to the max visible radius
-          float heat = fminf(speed / (SPEED * (maxr_vis * 2.0f) + 1e-3f), 1.0f);
-
-          // Rainbow index (time + radius + velocity), so it isn't just "inward gradient"
-          float rr = fminf(r / (maxr_vis + 1e-3f), 1.0f);
-          float hue = fmodf(0.12f * tnow + 0.85f * swirl_n + 0.40f * rr + 0.15f * heat, 1.0f);
-          int rainbow_idx = (int)floorf(hue * (float)BH_PAIR_COUNT);
-          if (rainbow_idx < 0) rainbow_idx = 0;
-          if (rainbow_idx >= BH_PAIR_COUNT) rainbow_idx = BH_PAIR_COUNT - 1;
-          int rainbow_pair = BH_PAIR_BASE + rainbow_idx;
-
-          int pair = rainbow_pair;
-          int do_bold = 0;
-          int do_dim  = 0;
-          int do_blink = 0;
-          int draw_it = 1;
-
-          // Deep shadow: mostly empty/dim near the center
-          if (r < shadow_r) {
-            if ((rand() & 3) != 0) {
-              draw_it = 0; // skip most chars to make a darker "shadow"
-            } else {
-              pair = BH_PAIR_BASE;
-              do_dim = 1;
-            }
-          } else {
-            // Bright photon-ring-like band, thickness reacts to swirl
-            float ring_thick = ring_w * (0.6f + 0.8f * swirl_n);
-            if (fabsf(r - ring_r) < ring_thick) {
-              // Ring flashes between white-hot and rainbow depending on swirl/time
-              int white_pair = BH_PAIR_BASE + (BH_PAIR_COUNT - 1);
-              pair = (((int)(tnow * 14.0f) & 1) || swirl_n > 0.55f) ? white_pair : rainbow_pair;
-              do_bold = 1;
-              if (swirl_n > 0.75f) do_blink = 1;
-            } else {
-              // Disk color is rainbow_pair; intensity comes from velocity/"heat" and swirl
-              float t = 0.60f * heat + 0.40f * swirl_n;
-              pair = rainbow_pair;
-
-              // Make it "flashy": occasional sparkles for fast-moving bits
-              if (t > 0.85f) {
-                do_bold = 1;
-                if ((rand() % 10) == 0) {
-                  pair = BH_PAIR_BASE + (BH_PAIR_COUNT - 1); // white sparkle
-                  do_blink = 1;
-                }
-              } else if (t > 0.65f) {
-                do_bold = 1;
-              } else if (t < 0.25f) {
-                do_dim = 1;
-              }
-
-              // Rare global twinkle (keeps it lively)
-              if ((rand() & 127) == 0) {
-                pair = BH_PAIR_BASE + (BH_PAIR_COUNT - 1);
-                do_bold = 1;
-                do_blink = 1;
-              }
-            }
-          }
-
-          if (draw_it) {
-            attron(COLOR_PAIR(pair));
-            if (do_bold)  attron(A_BOLD);
-            if (do_dim)   attron(A_DIM);
-            if (do_blink) attron(A_BLINK);
-            mvaddch(y, x, P[i].ch);
-            if (do_blink) attroff(A_BLINK);
-            if (do_dim)   attroff(A_DIM);
-            if (do_bold)  attroff(A_BOLD);
-            attroff(COLOR_PAIR(pair));
-          }
-        }
-      } else {
-        mvaddch(y, x, P[i].ch);
-      }
+    double tnow = now_seconds();
+    trace_begin("frame");
+    perfctr_begin(pc);
+    double stage[PC_STAGES], tmark = tnow, t;
+    trace_begin("update");
+    em_update(sim, wall ? wall_t : tnow);
+    if (wall && wall_updated(wall) < 0) {
+      wall_gone = 1;
+      break;
     }
-
-    refresh();
-    usleep(FPS_US);
+    trace_end("update");
+    perfctr_mark(pc, PC_UPDATE);
+    stage[PC_UPDATE] = (t = now_seconds()) - tmark, tmark = t;
+    trace_begin("color");
+    em_compose(sim);
+    trace_end("color");
+    perfctr_mark(pc, PC_COLOR);
+    stage[PC_COLOR] = (t = now_seconds()) - tmark, tmark = t;
+
+    long budget = -1;
+    if (max_bytes_frame > 0) {
+      budget = max_bytes_frame;
+    } else if (max_kbps > 0) {
+      double rate = (double)max_kbps * 125.0; // bytes per second
+      tokens += rate * (tnow - tlast);
+      if (tokens > rate * 0.05) tokens = rate * 0.05;
+      budget = (long)tokens;
+    }
+    tlast = tnow;
+
+    em_stats st;
+    em_get_stats(sim, &st);
+    const em_cell *frame = hud_overlay(&hud, em_cells(sim, NULL, NULL), &st, tnow);
+
+    trace_begin("emit");
+    be->begin_frame(be);
+    long spent = screen_present(&screen, be, frame, budget);
+    trace_end("emit");
+    perfctr_mark(pc, PC_EMIT);
+    stage[PC_EMIT] = (t = now_seconds()) - tmark, tmark = t;
+    trace_begin("flush");
+    be->end_frame(be);
+    trace_end("flush");
+    perfctr_mark(pc, PC_FLUSH);
+    stage[PC_FLUSH] = now_seconds() - tmark;
+    // Outside the timed stages: the copy is neither compose nor output.
+    if (pub) {
+      trace_begin("publish");
+      publish_frame(pub, em_cells(sim, NULL, NULL), rows, cols, wall ? wall_t : tnow);
+      trace_end("publish");
+    }
+    hud_frame(&hud, tnow, stage, be->frame_bytes);
+    if (wall) wall_done(wall);
+    trace_end("frame");
+    if (max_kbps > 0) tokens -= (double)spent;
   }
 
-  free(P);
+  close(ep); close(tfd); close(sfd);
+  if (wall) wall_leave(wall);
+  else      em_destroy(sim);
+  screen_free(&screen);
+  workers_destroy(pool);
+  hud_free(&hud);
+  be->destroy(be);
   endwin();
+  if (wall_gone) fprintf(stderr, "ematrix: the wall host has gone\n");
+  if (tune) autotune_report(&tuned, stderr);
+  perfctr_report(pc, stderr);
+  perfctr_close(pc);
+  trace_close();
+  publish_close(pub);
   return 0;
 }
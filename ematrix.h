@@ -0,0 +1,172 @@
+// libematrix: the particle swirl behind ematrix, as a small C library.
+//
+// A context owns every particle and the composed cell frame. The caller
+// supplies the clock: em_step(ctx, t) advances to time t (seconds, any
+// epoch, non-decreasing) and composes a fresh frame readable through
+// em_cells(). Nothing allocates after em_create/em_resize, and a context
+// is self-contained (own RNG and, unless lent a pool, worker threads; no
+// globals), so several can run side by side, one per thread.
+
+#ifndef EMATRIX_H
+#define EMATRIX_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EM_API_VERSION 11
+
+typedef struct em_ctx em_ctx;
+
+// One screen cell. ch == 0 means empty.
+typedef struct {
+  char          ch;
+  unsigned char pair;  // color pair (0 = default)
+  unsigned char attr;  // EM_BOLD | EM_DIM | EM_BLINK
+  unsigned char prio;  // EM_PRIO_* hint for bandwidth-limited output
+  unsigned char tc;    // truecolor palette index (0 = none), see em_tc_index()
+} em_cell;
+
+enum { EM_BOLD = 1, EM_DIM = 2, EM_BLINK = 4 };
+
+// Update priority classes, most important first.
+enum { EM_PRIO_RING, EM_PRIO_LIT, EM_PRIO_CHANGE, EM_PRIO_CLEAR, EM_PRIO_COUNT };
+
+// Truecolor palette: the continuous hue quantized to EM_TC_HUES steps at
+// EM_TC_LEVELS brightness levels, plus a few white levels for the ring.
+// Index 0 means "no truecolor" so a zeroed cell stays uncolored.
+#define EM_TC_HUES   48
+#define EM_TC_LEVELS 5
+#define EM_TC_WHITES 4
+#define EM_TC_COUNT  (1 + EM_TC_HUES * EM_TC_LEVELS + EM_TC_WHITES)
+
+unsigned char em_tc_index(float hue, float level);
+unsigned char em_tc_white(float level);
+
+// How em_update moves particles. All trace the same trajectories; they
+// differ in cost and in float rounding.
+enum {
+  EM_KERNEL_EXPA,      // closed-form exp(A t) per particle
+  EM_KERNEL_LUT,       // exp(A t) from interpolated tables
+  EM_KERNEL_EIGEN,     // complex coefficient times one shared per-frame factor
+};
+
+// exp / sin / cos used by EM_KERNEL_EXPA. Worst-case position error, as a
+// fraction of a particle's distance from the center: 3e-4 for FAST (0.03
+// cell 100 cells out) and 1e-5 for BALANCED, about the same as EXACT.
+enum {
+  EM_PRECISION_EXACT,     // libm
+  EM_PRECISION_BALANCED,  // higher-degree polynomials, near float rounding
+  EM_PRECISION_FAST,      // low-degree polynomials
+};
+
+// Instruction set for the vectorized update, binning and color kernels.
+// All give identical frames; AUTO takes the widest the CPU supports.
+enum {
+  EM_ISA_AUTO,
+  EM_ISA_SSE2,     // 4 lanes (the baseline build on non-x86 targets)
+  EM_ISA_AVX2,     // 8 lanes
+  EM_ISA_AVX512,   // 16 lanes
+};
+
+// Whether this CPU and build can run isa.
+int em_isa_supported(int isa);
+
+typedef struct {
+  unsigned seed;       // RNG seed; 0 picks one from the clock
+  int particles;       // 0: rows * cols / 20, at least 200
+  int colors;          // compose colors at all (else plain glyphs)
+  int truecolor;       // also fill em_cell.tc
+  int green_pair;      // pair for the default green look
+  int bh_pair_base;    // black-hole rainbow pairs, white last
+  int bh_pair_count;
+  int compact;         // 8-byte quantized particles (since API version 3)
+  int kernel;          // EM_KERNEL_*, ignored when compact (since API version 4)
+  int events;          // event-driven updates outside black-hole mode; implies
+                       // EM_KERNEL_EIGEN, ignored when compact (since API version 5)
+  int precision;       // EM_PRECISION_*, for EM_KERNEL_EXPA (since API version 6)
+  int isa;             // EM_ISA_*; em_create fails if unsupported (since API version 7)
+  int sort;            // keep particles roughly in screen tile order, so cell
+                       // writes sweep memory; ignored with events (since API version 8)
+  int threads;         // update and compose on this many threads, the caller's
+                       // included, with the same frames as one; event-driven
+                       // green updates stay on the caller, and wall contexts
+                       // use one (since API version 9)
+  struct Workers *workers;  // with threads > 1, run on this pool (workers.h)
+                       // instead of starting one, e.g. to share it with a
+                       // Screen; it stays the caller's and must outlive the
+                       // context (since API version 11)
+} em_config;
+
+void em_config_default(em_config *cfg);
+
+// Returns NULL on allocation failure or a bad size.
+em_ctx *em_create(const em_config *cfg, int rows, int cols);
+void    em_destroy(em_ctx *ctx);
+
+// Change the screen size; every particle respawns. Returns -1 on
+// allocation failure (the context keeps its old size).
+int em_resize(em_ctx *ctx, int rows, int cols);
+
+// 0: matrix green, 1: black-hole palette.
+void em_set_mode(em_ctx *ctx, int bh_mode);
+int  em_mode(const em_ctx *ctx);
+
+// Advance the simulation to time t and compose the frame.
+void em_step(em_ctx *ctx, double t);
+
+// em_step in its two stages, for callers that time them separately:
+// em_update moves (and respawns) particles, em_compose colors them into
+// the cell frame.
+void em_update(em_ctx *ctx, double t);
+void em_compose(em_ctx *ctx);
+
+// The last composed frame, rows * cols cells in row-major order.
+const em_cell *em_cells(const em_ctx *ctx, int *rows, int *cols);
+
+// Counters from the last em_update / em_compose (since API version 2).
+typedef struct {
+  int particles;   // total, fixed at creation
+  int visible;     // on screen after the last update
+  int respawns;    // respawned by the last update
+  int overdraw;    // cells the last compose drew more than once
+  int updated;     // particles the last update recomputed (since API version 5)
+  int isa;         // EM_ISA_* the kernels run on (since API version 7)
+} em_stats;
+
+void em_get_stats(const em_ctx *ctx, em_stats *st);
+
+// Video wall (since API version 10): one simulation of a rows x cols
+// canvas whose state lives in a caller-provided arena, usually a shared
+// memory mapping, split by particle range into nshards shards. A wall
+// context em_update()s only its own shard, and em_compose()s and
+// em_cells() a viewport of the whole canvas. Its em_resize() resizes the
+// viewport and leaves the particles alone.
+//
+// The caller keeps the contexts in step: a frame's updates of every shard
+// must all finish before any context composes it, and the composes before
+// the next frame's updates start. Every shard is updated once per frame
+// with the same t, counted in seconds from em_wall_format(). Seed, particle
+// count, compact, kernel and precision come from the arena; sort, events
+// and threads are ignored.
+
+// Bytes of arena needed; 0 for a bad size or shard count.
+size_t em_wall_size(const em_config *cfg, int rows, int cols, int nshards);
+
+// Lay out a zeroed arena of em_wall_size() bytes and spawn the particles.
+// Returns -1 on a bad size or allocation failure.
+int em_wall_format(void *arena, const em_config *cfg, int rows, int cols, int nshards);
+
+// A context updating shard (-1: none, compose only) whose rows x cols
+// viewport has its top left corner at canvas cell (y, x). NULL on
+// allocation failure, a bad shard or an arena em_wall_format() didn't lay out.
+em_ctx *em_wall_attach(void *arena, const em_config *cfg, int shard, int y, int x,
+                       int rows, int cols);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,91 @@
+// Polynomial exp / sin / cos for the particle update, in place of libm.
+//
+// Each function reduces its argument to a short interval with a
+// two-constant (Cody-Waite) subtraction and evaluates a minimax polynomial
+// there. They use only +, *, bit casts and integer shifts, no branches or
+// tables, so FM_DEFINE() can stamp them out for plain float as well as for
+// GCC vector types: FM_DEFINE(float, uint32_t, f) gives fm_exp_fastf() etc.;
+// a vector path instantiates it with a float vector and the unsigned
+// integer vector of the same width.
+//
+// Two levels, with the largest error of each reduced-range polynomial:
+//
+//   fast      exp 7.5e-5 relative, sin 6.8e-5, cos 6.7e-6
+//   balanced  exp 7.5e-8 relative, sin 5.9e-7, cos 4.7e-8
+//
+// In exp(A t) v0 fast stays within 3e-4 of a particle's distance from the
+// swirl's center, i.e. 0.03 cell for a particle 100 cells out (the edge of
+// a 200-column terminal). Balanced stays within 1e-5, the same as libm
+// (float rounding in the matrix itself dominates there). tests/golden.c
+// checks both bounds.
+//
+// Domains: fm_exp*(x) for -87 <= x <= 87, fm_sincos*(x) for |x| < 2^16.
+
+#ifndef EMATRIX_FASTMATH_H
+#define EMATRIX_FASTMATH_H
+
+#include <stdint.h>
+#include <string.h>
+
+// x + FM_MAGIC - FM_MAGIC rounds |x| < 2^22 to an integer, and the low bits
+// of x + FM_MAGIC hold that integer (two's complement) above FM_MAGIC_BITS.
+#define FM_MAGIC      12582912.0f  // 1.5 * 2^23
+#define FM_MAGIC_BITS 0x4B400000u
+
+#define FM_LOG2E  1.44269504f
+#define FM_LN2_HI 0.693145751953125f   // few mantissa bits, so n * HI is exact
+#define FM_LN2_LO 1.42860677e-06f
+#define FM_INV_PI 0.318309886f
+#define FM_PI_HI  3.140625f
+#define FM_PI_LO  9.67653590e-04f
+
+// e^r on [-ln2/2, ln2/2].
+#define FM_EXP_FAST(r) \
+  (0.999928074f + (r) * (1.00016419f + (r) * (0.504963264f + (r) * 0.165668424f)))
+#define FM_EXP_BALANCED(r) \
+  (1.00000007f + (r) * (0.999999692f + (r) * (0.499988949f + (r) * (0.166675747f + \
+   (r) * (0.0419153820f + (r) * 0.00829765520f)))))
+
+// sin(r) / r and cos(r) on [-pi/2, pi/2], in r2 = r * r.
+#define FM_SIN_FAST(r2) (0.999696773f + (r2) * (-0.165673080f + (r2) * 0.00751437725f))
+#define FM_COS_FAST(r2) \
+  (0.999993295f + (r2) * (-0.499912440f + (r2) * (0.0414877481f + (r2) * -0.00127120949f)))
+#define FM_SIN_BALANCED(r2) \
+  (0.999996616f + (r2) * (-0.166648284f + (r2) * (0.00830632523f + (r2) * -0.000183636541f)))
+#define FM_COS_BALANCED(r2) \
+  (0.999999953f + (r2) * (-0.499999053f + (r2) * (0.0416635847f + \
+   (r2) * (-0.00138537043f + (r2) * 2.31539320e-05f))))
+
+// e^x = 2^n e^r with n = round(x / ln2); 2^n is built in the exponent bits.
+#define FM_EXP_DEFINE(T, U, SFX, NAME, POLY)                                  \
+  static inline T fm_exp_##NAME##SFX(T x) {                                   \
+    T y = x * FM_LOG2E + FM_MAGIC;                                            \
+    T n = y - FM_MAGIC;                                                       \
+    T r = x - n * FM_LN2_HI - n * FM_LN2_LO;                                  \
+    U e = (fm_bits##SFX(y) - FM_MAGIC_BITS + 127u) << 23;                     \
+    return POLY(r) * fm_float##SFX(e);                                        \
+  }
+
+// x = k pi + r with |r| <= pi/2; an odd k flips the sign of both results.
+#define FM_SINCOS_DEFINE(T, U, SFX, NAME, SIN, COS)                           \
+  static inline void fm_sincos_##NAME##SFX(T x, T *s, T *c) {                 \
+    T y = x * FM_INV_PI + FM_MAGIC;                                           \
+    T k = y - FM_MAGIC;                                                       \
+    T r = x - k * FM_PI_HI - k * FM_PI_LO;                                    \
+    T r2 = r * r;                                                             \
+    U flip = fm_bits##SFX(y) << 31;                                           \
+    *s = fm_float##SFX(fm_bits##SFX(r * SIN(r2)) ^ flip);                     \
+    *c = fm_float##SFX(fm_bits##SFX(COS(r2)) ^ flip);                         \
+  }
+
+#define FM_DEFINE(T, U, SFX)                                                  \
+  static inline U fm_bits##SFX(T x) { U u; memcpy(&u, &x, sizeof(u)); return u; } \
+  static inline T fm_float##SFX(U u) { T x; memcpy(&x, &u, sizeof(x)); return x; } \
+  FM_EXP_DEFINE(T, U, SFX, fast, FM_EXP_FAST)                                 \
+  FM_EXP_DEFINE(T, U, SFX, balanced, FM_EXP_BALANCED)                         \
+  FM_SINCOS_DEFINE(T, U, SFX, fast, FM_SIN_FAST, FM_COS_FAST)                 \
+  FM_SINCOS_DEFINE(T, U, SFX, balanced, FM_SIN_BALANCED, FM_COS_BALANCED)
+
+FM_DEFINE(float, uint32_t, f)
+
+#endif
@@ -0,0 +1,124 @@
+// Performance overlay (see hud.h).
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hud.h"
+
+#define HUD_TEXT_HZ 4.0
+
+// Frame time in us to a histogram bucket: octave from the top bit, then
+// the next two bits pick a quarter of it.
+static int bucket_of(double us) {
+  if (us < 1.0) return 0;
+  unsigned v = us >= 4e9 ? 0xffffffffu : (unsigned)us;
+  int msb = 31 - __builtin_clz(v);
+  int sub = msb >= 2 ? (int)(v >> (msb - 2)) & 3 : (int)(v << (2 - msb)) & 3;
+  int b = msb * 4 + sub;
+  return b < HUD_BUCKETS ? b : HUD_BUCKETS - 1;
+}
+
+// Upper edge of bucket b, in us.
+static double bucket_top(int b) {
+  return ldexp(1.0 + (double)(b % 4 + 1) / 4.0, b / 4);
+}
+
+const char *hud_isa_name(int isa) {
+  static const char *names[] = {"auto", "sse2", "avx2", "avx512"};
+  return isa >= 0 && isa < (int)(sizeof(names) / sizeof(names[0])) ? names[isa] : "?";
+}
+
+int hud_resize(Hud *h, int rows, int cols) {
+  em_cell *f = (em_cell *)realloc(h->frame, (size_t)rows * (size_t)cols * sizeof(em_cell));
+  if (!f) return -1;
+  h->frame = f;
+  h->rows = rows;
+  h->cols = cols;
+  return 0;
+}
+
+void hud_free(Hud *h) {
+  free(h->frame);
+  h->frame = NULL;
+}
+
+void hud_frame(Hud *h, double t, const double stage_s[PC_STAGES], long bytes) {
+  int i = h->head;
+  if (h->count == HUD_WINDOW) {
+    // Evict the oldest frame, which sits where the new one goes.
+    h->hist[h->bucket[i]]--;
+    for (int s = 0; s < PC_STAGES; s++) h->stage_sum[s] -= h->stage_us[i][s];
+    if (h->bytes[i] > 0) h->bytes_sum -= h->bytes[i];
+  } else {
+    h->count++;
+  }
+
+  double work = 0.0;
+  for (int s = 0; s < PC_STAGES; s++) {
+    h->stage_us[i][s] = (float)(stage_s[s] * 1e6);
+    h->stage_sum[s] += h->stage_us[i][s];
+    work += stage_s[s];
+  }
+  h->bucket[i] = (unsigned char)bucket_of(work * 1e6);
+  h->hist[h->bucket[i]]++;
+  h->stamp[i] = t;
+  h->bytes[i] = bytes;
+  if (bytes > 0) h->bytes_sum += bytes;
+  h->head = (i + 1) % HUD_WINDOW;
+}
+
+static double percentile_ms(const Hud *h, double p) {
+  int want = (int)ceil(p * (double)h->count), seen = 0;
+  for (int b = 0; b < HUD_BUCKETS; b++)
+    if ((seen += h->hist[b]) >= want) return bucket_top(b) / 1000.0;
+  return bucket_top(HUD_BUCKETS - 1) / 1000.0;
+}
+
+static void hud_text(Hud *h, const em_stats *st) {
+  int newest = (h->head + HUD_WINDOW - 1) % HUD_WINDOW;
+  int oldest = h->count == HUD_WINDOW ? h->head : 0;
+  double span = h->stamp[newest] - h->stamp[oldest];
+  double fps = span > 0.0 ? (double)(h->count - 1) / span : 0.0;
+  double n = h->count ? (double)h->count : 1.0;
+
+  snprintf(h->text[0], HUD_WIDTH + 1, "%.1f fps  %s", fps, hud_isa_name(st->isa));
+  snprintf(h->text[1], HUD_WIDTH + 1, "frame p50 %.2f ms  p99 %.2f ms",
+           percentile_ms(h, 0.50), percentile_ms(h, 0.99));
+  snprintf(h->text[2], HUD_WIDTH + 1, "upd %.0f  col %.0f  emit %.0f  flush %.0f us",
+           h->stage_sum[PC_UPDATE] / n, h->stage_sum[PC_COLOR] / n,
+           h->stage_sum[PC_EMIT] / n, h->stage_sum[PC_FLUSH] / n);
+  snprintf(h->text[3], HUD_WIDTH + 1, "particles %d/%d  upd %d  respawn %d",
+           st->visible, st->particles, st->updated, st->respawns);
+  if (h->bytes[newest] < 0)
+    snprintf(h->text[4], HUD_WIDTH + 1, "overdraw %d  out n/a", st->overdraw);
+  else
+    snprintf(h->text[4], HUD_WIDTH + 1, "overdraw %d  out %.0f B/frame",
+             st->overdraw, (double)h->bytes_sum / n);
+}
+
+const em_cell *hud_overlay(Hud *h, const em_cell *frame, const em_stats *st, double t) {
+  if (!h->on || !h->frame) return frame;
+  if (t - h->text_at >= 1.0 / HUD_TEXT_HZ || t < h->text_at) {
+    hud_text(h, st);
+    h->text_at = t;
+  }
+
+  memcpy(h->frame, frame, (size_t)h->rows * (size_t)h->cols * sizeof(em_cell));
+  int w = HUD_WIDTH + 2 < h->cols ? HUD_WIDTH + 2 : h->cols;
+  for (int y = 0; y < HUD_LINES + 2 && y < h->rows; y++) {
+    const char *line = y >= 1 && y <= HUD_LINES ? h->text[y - 1] : "";
+    size_t len = strlen(line);
+    for (int x = 0; x < w; x++) {
+      em_cell *c = &h->frame[y * h->cols + x];
+      size_t k = (size_t)(x - 1);
+      c->ch = x >= 1 && k < len ? line[k] : ' ';
+      c->pair = 0;
+      c->attr = EM_BOLD;
+      c->prio = EM_PRIO_RING;  // readable even under a tight byte budget
+      c->tc = 0;
+    }
+  }
+  return h->frame;
+}
@@ -0,0 +1,52 @@
+// Performance overlay for the front end ('h' toggles it).
+//
+// The main loop feeds hud_frame() the time each stage took; the HUD keeps
+// the last HUD_WINDOW frames in fixed-size rolling histograms and draws a
+// small text box over the composed frame. Nothing allocates after
+// hud_resize(), and the text is only reformatted a few times a second.
+
+#ifndef EMATRIX_HUD_H
+#define EMATRIX_HUD_H
+
+#include "ematrix.h"
+#include "perfctr.h"   // PC_* stage indices
+
+#define HUD_WINDOW  256  // frames in the rolling window
+#define HUD_BUCKETS 64   // frame-time histogram, 4 buckets per octave of us
+#define HUD_LINES   5
+#define HUD_WIDTH   44
+
+typedef struct {
+  int on;
+  // Rolling window: per-frame work time bucket and stage times.
+  unsigned char bucket[HUD_WINDOW];
+  float  stage_us[HUD_WINDOW][PC_STAGES];
+  double stamp[HUD_WINDOW];      // frame start, seconds
+  int    hist[HUD_BUCKETS];
+  double stage_sum[PC_STAGES];
+  long   bytes_sum;
+  long   bytes[HUD_WINDOW];
+  int    head, count;
+  // Rendered text and the frame it is stamped onto.
+  char   text[HUD_LINES][HUD_WIDTH + 1];
+  double text_at;
+  em_cell *frame;
+  int rows, cols;
+} Hud;
+
+// "auto", "sse2", ... for an EM_ISA_* value.
+const char *hud_isa_name(int isa);
+
+// Size the overlay frame. Returns -1 on allocation failure.
+int  hud_resize(Hud *h, int rows, int cols);
+void hud_free(Hud *h);
+
+// Record one frame: its start time (seconds), the seconds spent in each
+// PC_* stage, and the bytes the backend emitted (< 0 if unknown).
+void hud_frame(Hud *h, double t, const double stage_s[PC_STAGES], long bytes);
+
+// frame with the HUD drawn over its top-left corner, or frame itself when
+// the HUD is off.
+const em_cell *hud_overlay(Hud *h, const em_cell *frame, const em_stats *st, double t);
+
+#endif
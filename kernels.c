@@ -0,0 +1,222 @@
+// Hot kernels behind libematrix (see kernels.h).
+
+#include <math.h>
+#include <pthread.h>
+
+#include "fastmath.h"
+#include "kernels.h"
+
+#define W_SQRT3_2 0.8660254037844386f // sqrt(3)/2
+
+// Analytic matrix exponential for A = [[-1,-1],[1,0]].
+// exp(A t) = e^{-0.5 t} [ cos(w t) I + (sin(w t)/w) (A + 0.5 I) ]
+// where w = sqrt(3)/2 ≈ 0.8660254
+void expA(float t, float M[2][2]) {
+  const float w = W_SQRT3_2;
+  float et = expf(-0.5f * t);
+  float c  = cosf(w * t);
+  float s  = sinf(w * t);
+  float k  = (fabsf(w) < 1e-8f) ? t : (s / w);
+
+  // B = A + 0.5 I = [[-0.5, -1],[1, 0.5]]
+  float B00 = -0.5f, B01 = -1.0f, B10 = 1.0f, B11 = 0.5f;
+
+  // M = et * ( c*I + k*B )
+  M[0][0] = et * (c + k * B00);
+  M[0][1] = et * (    k * B01);
+  M[1][0] = et * (    k * B10);
+  M[1][1] = et * (c + k * B11);
+}
+
+// exp(A t) from e^{-0.5 t}, cos(w t) and sin(w t), as in expA().
+static inline void expA_from(float et, float c, float s, float M[2][2]) {
+  float k = s * (1.0f / W_SQRT3_2);
+  M[0][0] = et * (c - 0.5f * k);
+  M[0][1] = et * (   -1.0f * k);
+  M[1][0] = et * (    1.0f * k);
+  M[1][1] = et * (c + 0.5f * k);
+}
+
+void expA_fast(float t, float M[2][2]) {
+  float s, c;
+  t = t < -EXPA_FM_MAX_T ? -EXPA_FM_MAX_T : t > EXPA_FM_MAX_T ? EXPA_FM_MAX_T : t;
+  fm_sincos_fastf(W_SQRT3_2 * t, &s, &c);
+  expA_from(fm_exp_fastf(-0.5f * t), c, s, M);
+}
+
+void expA_balanced(float t, float M[2][2]) {
+  float s, c;
+  t = t < -EXPA_FM_MAX_T ? -EXPA_FM_MAX_T : t > EXPA_FM_MAX_T ? EXPA_FM_MAX_T : t;
+  fm_sincos_balancedf(W_SQRT3_2 * t, &s, &c);
+  expA_from(fm_exp_balancedf(-0.5f * t), c, s, M);
+}
+
+#define LUT_N      EXPA_LUT_N
+#define ANGLE_BITS PC_ANGLE_BITS
+#define ANGLE_N    (1 << ANGLE_BITS)
+
+float lut_et[LUT_N], lut_c[LUT_N], lut_k[LUT_N];
+float lut_cos[ANGLE_N + 1], lut_sin[ANGLE_N + 1];
+float lut_rhi[256], lut_rlo[256];
+static pthread_once_t lut_once = PTHREAD_ONCE_INIT;
+
+static void lut_build(void) {
+  for (int i = 0; i < LUT_N; i++) {
+    float t = (float)i / (float)EXPA_LUT_RES;
+    lut_et[i] = expf(-0.5f * t);
+    lut_c[i]  = cosf(W_SQRT3_2 * t);
+    lut_k[i]  = sinf(W_SQRT3_2 * t) / W_SQRT3_2;
+  }
+  for (int i = 0; i <= ANGLE_N; i++) {
+    double a = 2.0 * M_PI * (double)i / (double)ANGLE_N;
+    lut_cos[i] = (float)cos(a);
+    lut_sin[i] = (float)sin(a);
+  }
+  for (int i = 0; i < 256; i++) {
+    lut_rhi[i] = (float)exp((double)PC_LR_MIN + (double)(i << 8) / (double)PC_LR_RES);
+    lut_rlo[i] = (float)exp((double)i / (double)PC_LR_RES);
+  }
+}
+
+void expA_lut_init(void) {
+  pthread_once(&lut_once, lut_build);
+}
+
+void expA_lut(float t, float M[2][2]) {
+  float u = t * (float)EXPA_LUT_RES;
+  if (!(u >= 0.0f && u < (float)(LUT_N - 1))) {
+    expA(t, M);
+    return;
+  }
+  int   i = (int)u;
+  float f = u - (float)i;
+  float et = lut_et[i] + f * (lut_et[i + 1] - lut_et[i]);
+  float c  = lut_c[i]  + f * (lut_c[i + 1]  - lut_c[i]);
+  float k  = lut_k[i]  + f * (lut_k[i + 1]  - lut_k[i]);
+
+  M[0][0] = et * (c - 0.5f * k);
+  M[0][1] = et * (   -1.0f * k);
+  M[1][0] = et * (    1.0f * k);
+  M[1][1] = et * (c + 0.5f * k);
+}
+
+void expA_advance(float M[2][2], const float E[2][2]) {
+  float m00 = E[0][0] * M[0][0] + E[0][1] * M[1][0];
+  float m01 = E[0][0] * M[0][1] + E[0][1] * M[1][1];
+  float m10 = E[1][0] * M[0][0] + E[1][1] * M[1][0];
+  float m11 = E[1][0] * M[0][1] + E[1][1] * M[1][1];
+  M[0][0] = m00; M[0][1] = m01;
+  M[1][0] = m10; M[1][1] = m11;
+}
+
+const char glyph_set[GLYPH_COUNT + 1] =
+    "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz@#$%&*+=-";
+
+char rand_char(uint64_t *rng) {
+  return glyph_set[rng_next(rng) % GLYPH_COUNT];
+}
+
+void respawn_batch(Particle *p, const int *idx, int n, int rows, int cols,
+                   float now, uint64_t *rng) {
+  // Spawn somewhere in a ring around the center
+  float cx = (cols - 1) * 0.5f;
+  float cy = (rows - 1) * 0.5f;
+  float maxr = fminf(cx, cy);
+
+  for (int j = 0; j < n; j++) {
+    Particle *q = &p[idx[j]];
+    // Stash radius and angle in the vector until the trig pass below.
+    q->vx0 = rng_float(rng, maxr * 0.35f, maxr * 2.95f);
+    q->vy0 = rng_float(rng, 0.0f, 2.0f * (float)M_PI);
+    q->born = now;
+    q->ch = rand_char(rng);
+    q->mutate = (uint16_t)mutate_skip(rng_next(rng));
+  }
+  for (int j = 0; j < n; j++) {
+    Particle *q = &p[idx[j]];
+    float r = q->vx0, a = q->vy0;
+    q->vx0 = r * cosf(a);
+    q->vy0 = r * sinf(a);
+  }
+}
+
+void respawn_compact(ParticleC *p, const int *idx, int n, int rows, int cols,
+                     uint16_t now_tick, float rscale, uint64_t *rng) {
+  float cx = (cols - 1) * 0.5f;
+  float cy = (rows - 1) * 0.5f;
+  float maxr = fminf(cx, cy);
+
+  for (int j = 0; j < n; j++) {
+    ParticleC *q = &p[idx[j]];
+    float r = rng_float(rng, maxr * 0.35f, maxr * 2.95f) * rscale;
+    float lr = (logf(fmaxf(r, 1e-6f)) - PC_LR_MIN) * PC_LR_RES + 0.5f;
+    q->lr = (uint16_t)fminf(fmaxf(lr, 0.0f), 65535.0f);
+    q->angle = (uint16_t)(rng_next(rng) >> 16);
+    q->born = now_tick;
+    q->glyph = rand_glyph(rng);
+    unsigned skip = mutate_skip(rng_next(rng));
+    q->mutate = (uint8_t)(skip < 255 ? skip : 255);  // 1 in 10^4 draws
+  }
+}
+
+void decode_compact(const ParticleC *p, int n, uint16_t now, float speed,
+                    float *vx, float *vy) {
+  const float tick_t = speed / (float)PC_TICK_HZ * (float)EXPA_LUT_RES;
+  for (int i = 0; i < n; i++) {
+    // exp(A t) from the expA_lut() tables; ages off the end clamp to the
+    // last entry and are zeroed through `live`.
+    float u = (float)(uint16_t)(now - p[i].born) * tick_t;
+    float live = u < (float)(LUT_N - 1) ? 1.0f : 0.0f;
+    u = fminf(u, (float)(LUT_N - 2));
+    int   t = (int)u;
+    float f = u - (float)t;
+    float et = lut_et[t] + f * (lut_et[t + 1] - lut_et[t]);
+    float c  = lut_c[t]  + f * (lut_c[t + 1]  - lut_c[t]);
+    float k  = lut_k[t]  + f * (lut_k[t + 1]  - lut_k[t]);
+
+    int   a  = p[i].angle >> (16 - ANGLE_BITS);
+    float fa = (float)(p[i].angle & ((1 << (16 - ANGLE_BITS)) - 1)) *
+               (1.0f / (float)(1 << (16 - ANGLE_BITS)));
+    float ca = lut_cos[a] + fa * (lut_cos[a + 1] - lut_cos[a]);
+    float sa = lut_sin[a] + fa * (lut_sin[a + 1] - lut_sin[a]);
+
+    float r = lut_rhi[p[i].lr >> 8] * lut_rlo[p[i].lr & 255] * et * live;
+    // exp(A t) (cos a, sin a) with B = A + I/2 = [[-1/2, -1], [1, 1/2]]
+    vx[i] = r * ((c - 0.5f * k) * ca - k * sa);
+    vy[i] = r * (k * ca + (c + 0.5f * k) * sa);
+  }
+}
+
+#define SQRT3 1.7320508075688772f
+
+cplx eigen_factor(double t) {
+  double m = exp(-0.5 * t), a = 0.8660254037844386 * t;
+  return (cplx){(float)(m * cos(a)), (float)(m * sin(a))};
+}
+
+void eigen_from_xy(Particle *p, const int *idx, int n, cplx g) {
+  for (int j = 0; j < n; j++) {
+    Particle *q = &p[idx[j]];
+    cplx beta = {0.5f * q->vx0, (q->vy0 + 0.5f * q->vx0) * (1.0f / SQRT3)};
+    cplx w = cplx_mul(beta, g);
+    q->vx0 = w.re;
+    q->vy0 = w.im;
+  }
+}
+
+void eigen_rebase(Particle *p, int n, cplx g) {
+  for (int i = 0; i < n; i++) {
+    cplx w = cplx_mul((cplx){p[i].vx0, p[i].vy0}, g);
+    p[i].vx0 = w.re;
+    p[i].vy0 = w.im;
+  }
+}
+
+void eigen_positions(const Particle *p, int n, cplx f, float *vx, float *vy) {
+  for (int i = 0; i < n; i++) {
+    float re = p[i].vx0 * f.re - p[i].vy0 * f.im;
+    float im = p[i].vx0 * f.im + p[i].vy0 * f.re;
+    vx[i] = 2.0f * re;
+    vy[i] = SQRT3 * im - re;
+  }
+}
@@ -0,0 +1,216 @@
+// Hot kernels behind libematrix, shared with the benchmarks. Internal:
+// not part of the stable API in ematrix.h and free to change.
+
+#ifndef EMATRIX_KERNELS_H
+#define EMATRIX_KERNELS_H
+
+#include <math.h>
+#include <stdint.h>
+
+typedef struct {
+  float vx0, vy0;     // initial vector (relative to center); in the
+                      // eigenbasis kernel the coefficient w (see below)
+  float born;         // birth time (seconds since the context's epoch)
+  char  ch;           // character to draw
+  uint16_t mutate;    // visible frames left until ch mutates (in padding)
+} Particle;
+
+// Compact particle, 8 bytes: the initial vector in quantized polar form
+// and the birth time in ticks of 1/PC_TICK_HZ s (wrapping; particles die
+// long before the 65536 ticks it takes to alias).
+typedef struct {
+  uint16_t angle;     // initial direction, 2 pi / 65536 steps
+  uint16_t lr;        // log of the initial radius: PC_LR_MIN + lr / PC_LR_RES
+  uint16_t born;      // birth tick
+  uint8_t  glyph;     // index into the glyph set, see glyph_char()
+  uint8_t  mutate;    // as Particle.mutate, clamped to 255
+} ParticleC;
+
+#define PC_TICK_HZ 200
+#define PC_LR_RES  4096.0f
+#define PC_LR_MIN  (-4.0f)
+
+// Analytic matrix exponential for A = [[-1,-1],[1,0]] (closed form).
+void expA(float t, float M[2][2]);
+
+// Same, with fastmath.h's polynomials in place of expf / cosf / sinf; the
+// error bounds are documented there. |t| is clamped to EXPA_FM_MAX_T, far
+// past the age at which any particle is still visible.
+#define EXPA_FM_MAX_T 170.0f
+void expA_fast(float t, float M[2][2]);
+void expA_balanced(float t, float M[2][2]);
+
+// Same, from a table of e^{-0.5 t}, cos(w t) and sin(w t)/w sampled every
+// 1/EXPA_LUT_RES over [0, EXPA_LUT_MAX) with linear interpolation; falls
+// back to expA() past the end. Call expA_lut_init() once first; it also
+// builds the tables behind decode_compact().
+#define EXPA_LUT_RES 64
+#define EXPA_LUT_MAX 32
+void expA_lut_init(void);
+void expA_lut(float t, float M[2][2]);
+
+// Incremental form: exp(A (t + h)) = exp(A h) exp(A t), so a running
+// matrix only needs one 2x2 product per step with a shared E = expA(h).
+void expA_advance(float M[2][2], const float E[2][2]);
+
+// Eigenbasis form. A has eigenvalues lambda = -1/2 +- i sqrt(3)/2, and
+// with P = [[2, 0], [-1, sqrt(3)]] it is A = P J P^-1, J being multiplication
+// by lambda on (re, im). So v(t) = P (beta e^{lambda t}) with
+// beta = (x0 / 2, (y0 + x0 / 2) / sqrt(3)). A particle stores
+// w = beta e^{-lambda (born - E)} against a shared epoch E, and every
+// particle's position at time T is w times the one per-frame factor
+// f = e^{lambda (T - E)}, projected by P. Times are in the model's units
+// (age scaled by speed). Keep T - E small (rebase) so |w| stays in range.
+typedef struct { float re, im; } cplx;
+
+static inline cplx cplx_mul(cplx a, cplx b) {
+  return (cplx){a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re};
+}
+
+// e^{lambda t}, in double so a large shared factor stays accurate.
+cplx eigen_factor(double t);
+
+// Turn p[idx[0..n)]'s (vx0, vy0) into w, for particles born at E + t
+// where g = eigen_factor(-t).
+void eigen_from_xy(Particle *p, const int *idx, int n, cplx g);
+
+// Multiply every w by g = eigen_factor(E' - E) to move the epoch to E'.
+void eigen_rebase(Particle *p, int n, cplx g);
+
+// Positions of n particles for the per-frame factor f.
+void eigen_positions(const Particle *p, int n, cplx f, float *vx, float *vy);
+
+// A particle that survived the update, waiting to be colored.
+typedef struct {
+  int   cell;         // y * cols + x
+  int   idx;          // particle index
+  float vx, vy;       // position in the un-stretched (vx,vy) space
+  float r, age;
+  char  ch;
+} Draw;
+
+// SIMD kernels, built once per instruction set in kernels_simd.c and
+// picked at runtime. Every set produces bit-identical results, equal to
+// the scalar code they stand in for.
+typedef struct {
+  float cx, cy;       // screen center
+  float xmult, ymult; // stretch from (vx, vy) to cells
+  float min_r;        // particles closer than this to the center die
+  int   rows, cols;
+} BinGeom;
+
+typedef struct {
+  float speed;        // age units per second
+  float heat_div;     // speed * (2 * max visible radius) + 1e-3
+  float rr_div;       // max visible radius + 1e-3
+  float hue0;         // 0.12 * now
+} ShadeGeom;
+
+typedef struct {
+  const char *name;
+  int isa;            // EM_ISA_*
+  // eigen_positions() above.
+  void (*eigen_positions)(const Particle *p, int n, cplx f, float *vx, float *vy);
+  // Positions scale * exp(A age) v0 with age = (tnow - born) * speed, via
+  // expA_fast() (fast != 0) or expA_balanced().
+  void (*expa_positions)(const Particle *p, int n, float tnow, float speed,
+                         float scale, int fast, float *vx, float *vy);
+  // decode_compact() below.
+  void (*decode_compact)(const ParticleC *p, int n, uint16_t now, float speed,
+                         float *vx, float *vy);
+  // Cell of each position (-1: dead) and its distance from the center.
+  void (*bin)(const float *vx, const float *vy, int n, const BinGeom *g,
+              int *cell, float *r);
+  // Black-hole look inputs per draw: swirl (0..1), heat (0..1) and hue.
+  void (*bh_shade)(const Draw *d, int n, const ShadeGeom *g, float *swirl_n,
+                   float *heat, float *hue);
+} KernelSet;
+
+// The set for EM_ISA_*, the best this CPU runs for EM_ISA_AUTO, or NULL
+// if the CPU (or the build) lacks it.
+const KernelSet *kernel_set(int isa);
+
+// xorshift64*: small, fast, and private to whoever holds the state.
+static inline uint32_t rng_next(uint64_t *s) {
+  uint64_t x = *s;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *s = x;
+  return (uint32_t)((x * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+// splitmix64 finalizer: a stateless hash, good enough to use as a
+// counter-based generator.
+static inline uint64_t mix64(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+// Counter-based randomness: 64 bits for particle id in frame, under a
+// per-context key. Distinct (id, frame) pairs give distinct inputs and
+// mix64 is a bijection, so draws never repeat within 2^32 frames, and
+// any thread can make one without shared state.
+static inline uint64_t ctr_rand(uint64_t key, uint32_t id, uint32_t frame) {
+  return mix64(key ^ ((uint64_t)frame << 32 | id));
+}
+
+// A glyph mutates on each visible frame with probability 1/MUTATE_ODDS.
+// Rather than rolling for it every frame, the number of frames to the
+// next mutation is drawn once from the matching geometric distribution
+// (>= 1, mean MUTATE_ODDS) and counted down: 1 + floor(ln u / ln(1 - p))
+// with u uniform in (0, 1] from the top 24 bits of x. At most 458, from the
+// smallest u: 1 + floor(24 ln 2 / ln(28/27)).
+#define MUTATE_ODDS 28
+static inline unsigned mutate_skip(uint32_t x) {
+  float u = (float)((x >> 8) + 1) * (1.0f / 16777216.0f);
+  return 1u + (unsigned)(logf(u) * (1.0f / -0.0363676442f));  // ln(27/28)
+}
+
+static inline float rng_float(uint64_t *s, float a, float b) {
+  return a + (b - a) * (float)(rng_next(s) >> 8) * (1.0f / 16777216.0f);
+}
+
+char rand_char(uint64_t *rng);
+
+// The glyph set rand_char() draws from, for compact particles.
+extern const char glyph_set[];
+#define GLYPH_COUNT 71
+static inline char glyph_char(uint8_t g) { return glyph_set[g]; }
+static inline uint8_t rand_glyph(uint64_t *rng) {
+  return (uint8_t)(rng_next(rng) % GLYPH_COUNT);
+}
+
+// Respawn p[idx[0..n)] somewhere in a ring around the center of a
+// rows x cols screen, born at time now. Draws all the randoms first and
+// then does the trig in one tight loop.
+void respawn_batch(Particle *p, const int *idx, int n, int rows, int cols,
+                   float now, uint64_t *rng);
+
+// The same for compact particles. The radius is stored multiplied by
+// rscale, so decoding needs no further scaling.
+void respawn_compact(ParticleC *p, const int *idx, int n, int rows, int cols,
+                     uint16_t now_tick, float rscale, uint64_t *rng);
+
+// Decode n compact particles at tick now into positions (vx[i], vy[i]),
+// with ages scaled by speed. Table driven: the radius comes from two
+// exp() tables, the direction from a cos/sin table and exp(A t) from the
+// expA_lut() tables, and there are no branches, so each lane of a SIMD
+// version is the same few loads and multiplies. Particles past the
+// tables' age decode to (0, 0).
+// Needs expA_lut_init(). KernelSet.decode_compact is the same, vectorized.
+void decode_compact(const ParticleC *p, int n, uint16_t now, float speed,
+                    float *vx, float *vy);
+
+// The tables behind it, filled by expA_lut_init(): exp(A t) as in
+// expA_lut(), cos/sin of the stored angle every 2 pi / 2^PC_ANGLE_BITS,
+// and exp(PC_LR_MIN + lr / PC_LR_RES) split into high and low bytes of lr.
+#define EXPA_LUT_N    (EXPA_LUT_MAX * EXPA_LUT_RES + 1)
+#define PC_ANGLE_BITS 10
+extern float lut_et[EXPA_LUT_N], lut_c[EXPA_LUT_N], lut_k[EXPA_LUT_N];
+extern float lut_cos[(1 << PC_ANGLE_BITS) + 1], lut_sin[(1 << PC_ANGLE_BITS) + 1];
+extern float lut_rhi[256], lut_rlo[256];
+
+#endif
@@ -0,0 +1,209 @@
+// Body of the SIMD kernels, included by kernels_simd.c once per
+// instruction set with ISA (the name suffix), ISA_ID (its EM_ISA_*) and
+// VBYTES (vector width) defined, VSQRT(v) mapped to that width's square
+// root instruction and the matching target pragma in effect.
+//
+// Each kernel mirrors a scalar loop in libematrix.c / kernels.c operation
+// for operation, so with contraction off the results are bit-identical to
+// it and to every other width. Loops run VW lanes at a time; the tail goes
+// through zero-padded lanes and only the live ones are stored.
+
+#define CAT_(a, b) a##_##b
+#define CAT(a, b)  CAT_(a, b)
+#define FN(name)   CAT(name, ISA)
+#define STR_(a)    #a
+#define STR(a)     STR_(a)
+#define FM_DEFINE_ISA(...) FM_DEFINE(__VA_ARGS__)  // expand FN() before pasting
+
+#define VW  (VBYTES / 4)
+#define vf  FN(vf)
+#define vu  FN(vu)
+#define vi  FN(vi)
+
+typedef float    vf __attribute__((vector_size(VBYTES)));
+typedef uint32_t vu __attribute__((vector_size(VBYTES)));
+typedef int32_t  vi __attribute__((vector_size(VBYTES)));
+
+FM_DEFINE_ISA(vf, vu, FN(v))
+
+// Lane-wise a < b ? a : b (as fminf for non-NaN inputs; a NaN a gives b).
+static inline vf FN(vmin)(vf a, vf b) {
+  vu m = (vu)(a < b);
+  return FN(fm_floatv)((FN(fm_bitsv)(a) & m) | (FN(fm_bitsv)(b) & ~m));
+}
+
+// Round half away from zero, as lroundf, for |x| < 2^31; anything larger
+// comes out as INT_MIN.
+static inline vi FN(vround)(vf x) {
+  vi t = __builtin_convertvector(x, vi);
+  vf d = x - __builtin_convertvector(t, vf);
+  return t - (vi)(d >= 0.5f) + (vi)(d <= -0.5f);
+}
+
+static inline vf FN(load)(const float *p, int m) {
+  vf v = {0};
+  if (m == VW) memcpy(&v, p, sizeof(v));
+  else for (int k = 0; k < m; k++) v[k] = p[k];
+  return v;
+}
+
+static inline void FN(store)(float *p, vf v, int m) {
+  if (m == VW) memcpy(p, &v, sizeof(v));
+  else for (int k = 0; k < m; k++) p[k] = v[k];
+}
+
+static inline void FN(store_i)(int *p, vi v, int m) {
+  if (m == VW) memcpy(p, &v, sizeof(v));
+  else for (int k = 0; k < m; k++) p[k] = v[k];
+}
+
+static void FN(eigen_positions)(const Particle *p, int n, cplx f, float *vx, float *vy) {
+  for (int i = 0; i < n; i += VW) {
+    int m = n - i < VW ? n - i : VW;
+    vf wr = {0}, wi = {0};
+    for (int k = 0; k < m; k++) wr[k] = p[i + k].vx0, wi[k] = p[i + k].vy0;
+    vf re = wr * f.re - wi * f.im;
+    vf im = wr * f.im + wi * f.re;
+    FN(store)(vx + i, 2.0f * re, m);
+    FN(store)(vy + i, SQRT3 * im - re, m);
+  }
+}
+
+// exp(A age) v0 * scale as update_particles() with expA_fast / expA_balanced.
+static void FN(expa_positions)(const Particle *p, int n, float tnow, float speed,
+                               float scale, int fast, float *vx, float *vy) {
+  for (int i = 0; i < n; i += VW) {
+    int m = n - i < VW ? n - i : VW;
+    vf born = {0}, x0 = {0}, y0 = {0};
+    for (int k = 0; k < m; k++) {
+      born[k] = p[i + k].born;
+      x0[k] = p[i + k].vx0;
+      y0[k] = p[i + k].vy0;
+    }
+    vf t = (tnow - born) * speed;
+    vf lo = (vf){0} - EXPA_FM_MAX_T, hi = (vf){0} + EXPA_FM_MAX_T;
+    vu below = (vu)(t < lo), above = (vu)(t > hi);
+    t = FN(fm_floatv)((FN(fm_bitsv)(t) & ~(below | above)) | (FN(fm_bitsv)(lo) & below) |
+                      (FN(fm_bitsv)(hi) & above));
+
+    vf s, c, et;
+    if (fast) {
+      FN(fm_sincos_fastv)(W_SQRT3_2 * t, &s, &c);
+      et = FN(fm_exp_fastv)(-0.5f * t);
+    } else {
+      FN(fm_sincos_balancedv)(W_SQRT3_2 * t, &s, &c);
+      et = FN(fm_exp_balancedv)(-0.5f * t);
+    }
+    vf kk = s * (1.0f / W_SQRT3_2);
+    vf m00 = et * (c - 0.5f * kk);
+    vf m01 = et * (-1.0f * kk);
+    vf m10 = et * (1.0f * kk);
+    vf m11 = et * (c + 0.5f * kk);
+    FN(store)(vx + i, scale * (m00 * x0 + m01 * y0), m);
+    FN(store)(vy + i, scale * (m10 * x0 + m11 * y0), m);
+  }
+}
+
+// decode_compact() a vector at a time: the table lookups are per lane,
+// the interpolation and the rotation vectorized.
+static void FN(decode_compact)(const ParticleC *p, int n, uint16_t now, float speed,
+                               float *vx, float *vy) {
+  const float tick_t = speed / (float)PC_TICK_HZ * (float)EXPA_LUT_RES;
+  const int fbits = 16 - PC_ANGLE_BITS;
+  for (int i = 0; i < n; i += VW) {
+    int m = n - i < VW ? n - i : VW;
+    vf age = {0}, fa = {0}, rad = {0};
+    vi ang = {0};
+    for (int k = 0; k < m; k++) {
+      const ParticleC *q = &p[i + k];
+      age[k] = (float)(uint16_t)(now - q->born);
+      ang[k] = q->angle >> fbits;
+      fa[k] = (float)(q->angle & ((1 << fbits) - 1));
+      rad[k] = lut_rhi[q->lr >> 8] * lut_rlo[q->lr & 255];
+    }
+    vf u = age * tick_t;
+    vu live = (vu)(u < (float)(EXPA_LUT_N - 1));
+    u = FN(vmin)(u, (vf){0} + (float)(EXPA_LUT_N - 2));
+    vi t = __builtin_convertvector(u, vi);
+    vf f = u - __builtin_convertvector(t, vf);
+    fa = fa * (1.0f / (float)(1 << fbits));
+
+    vf et0, et1, c0, c1, k0, k1, cos0, cos1, sin0, sin1;
+    for (int k = 0; k < VW; k++) {
+      et0[k] = lut_et[t[k]], et1[k] = lut_et[t[k] + 1];
+      c0[k] = lut_c[t[k]], c1[k] = lut_c[t[k] + 1];
+      k0[k] = lut_k[t[k]], k1[k] = lut_k[t[k] + 1];
+      cos0[k] = lut_cos[ang[k]], cos1[k] = lut_cos[ang[k] + 1];
+      sin0[k] = lut_sin[ang[k]], sin1[k] = lut_sin[ang[k] + 1];
+    }
+    vf et = et0 + f * (et1 - et0);
+    vf c  = c0 + f * (c1 - c0);
+    vf kk = k0 + f * (k1 - k0);
+    vf ca = cos0 + fa * (cos1 - cos0);
+    vf sa = sin0 + fa * (sin1 - sin0);
+
+    vf r = FN(fm_floatv)(FN(fm_bitsv)(rad * et) & live);
+    FN(store)(vx + i, r * ((c - 0.5f * kk) * ca - kk * sa), m);
+    FN(store)(vy + i, r * (kk * ca + (c + 0.5f * kk) * sa), m);
+  }
+}
+
+// The cell for each position, or -1 once it is near the center or
+// off-screen, as place() decides it; r[] gets the distance from the center.
+static void FN(bin)(const float *vx, const float *vy, int n, const BinGeom *g,
+                    int *cell, float *r) {
+  for (int i = 0; i < n; i += VW) {
+    int m = n - i < VW ? n - i : VW;
+    vf x = FN(load)(vx + i, m), y = FN(load)(vy + i, m);
+    vf rr = VSQRT(x * x + y * y);
+    vi cx = FN(vround)(g->cx + g->xmult * x);
+    vi cy = FN(vround)(g->cy + g->ymult * y);
+    vi dead = (vi)(rr < g->min_r) | (cx < 0) | (cx >= g->cols) | (cy < 0) | (cy >= g->rows);
+    FN(store_i)(cell + i, ((cy * g->cols + cx) & ~dead) | dead, m);
+    FN(store)(r + i, rr, m);
+  }
+}
+
+// The continuous part of the black-hole look for each draw (see
+// em_compose()): normalized swirl, heat and rainbow hue.
+static void FN(bh_shade)(const Draw *d, int n, const ShadeGeom *g, float *swirl_n,
+                         float *heat, float *hue) {
+  for (int i = 0; i < n; i += VW) {
+    int m = n - i < VW ? n - i : VW;
+    vf x = {0}, y = {0}, r = {0};
+    for (int k = 0; k < m; k++) x[k] = d[i + k].vx, y[k] = d[i + k].vy, r[k] = d[i + k].r;
+    vf one = (vf){0} + 1.0f;
+    vf ax = -x - y;
+    vf ay = x;
+    vf sp = g->speed * VSQRT(ax * ax + ay * ay);
+    vf sw = FN(vmin)(sp / (r + 1e-3f) / 2.0f, one);
+    vf ht = FN(vmin)(sp / g->heat_div, one);
+    vf rr = FN(vmin)(r / g->rr_div, one);
+    vf h = g->hue0 + 0.85f * sw + 0.40f * rr + 0.15f * ht;
+    h -= __builtin_convertvector(__builtin_convertvector(h, vi), vf);  // fmodf(h, 1), h >= 0
+    FN(store)(swirl_n + i, sw, m);
+    FN(store)(heat + i, ht, m);
+    FN(store)(hue + i, h, m);
+  }
+}
+
+static const KernelSet FN(kernels) = {
+  STR(ISA),
+  ISA_ID,
+  FN(eigen_positions),
+  FN(expa_positions),
+  FN(decode_compact),
+  FN(bin),
+  FN(bh_shade),
+};
+
+#undef VW
+#undef vf
+#undef vu
+#undef vi
+#undef FN
+#undef CAT
+#undef CAT_
+#undef STR
+#undef STR_
+#undef FM_DEFINE_ISA
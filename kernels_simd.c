@@ -0,0 +1,101 @@
+// The SIMD kernels (kernels_isa.h) built for each instruction set, and
+// the runtime pick between them (see kernel_set() in kernels.h).
+//
+// This file is compiled with -ffp-contract=off: an FMA would round
+// differently from the separate multiply and add of the scalar code, and
+// the golden tests expect every ISA to produce the same frames.
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ematrix.h"
+#include "fastmath.h"
+#include "kernels.h"
+
+#define W_SQRT3_2 0.8660254037844386f  // sqrt(3)/2
+#define SQRT3     1.7320508075688772f
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+#define ISA    sse2
+#define ISA_ID EM_ISA_SSE2
+#define VBYTES 16
+#define VSQRT(v) ((__typeof__(v))_mm_sqrt_ps((__m128)(v)))
+#include "kernels_isa.h"
+#undef ISA
+#undef ISA_ID
+#undef VBYTES
+#undef VSQRT
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#define ISA    avx2
+#define ISA_ID EM_ISA_AVX2
+#define VBYTES 32
+#define VSQRT(v) ((__typeof__(v))_mm256_sqrt_ps((__m256)(v)))
+#include "kernels_isa.h"
+#undef ISA
+#undef ISA_ID
+#undef VBYTES
+#undef VSQRT
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#define ISA    avx512
+#define ISA_ID EM_ISA_AVX512
+#define VBYTES 64
+#define VSQRT(v) ((__typeof__(v))_mm512_sqrt_ps((__m512)(v)))
+#include "kernels_isa.h"
+#undef ISA
+#undef ISA_ID
+#undef VBYTES
+#undef VSQRT
+#pragma GCC pop_options
+
+static int isa_usable(int isa) {
+  __builtin_cpu_init();
+  switch (isa) {
+  case EM_ISA_SSE2:   return 1;  // baseline on x86-64
+  case EM_ISA_AVX2:   return __builtin_cpu_supports("avx2");
+  case EM_ISA_AVX512: return __builtin_cpu_supports("avx512f");
+  default:            return 0;
+  }
+}
+
+static const KernelSet *isa_set(int isa) {
+  switch (isa) {
+  case EM_ISA_SSE2:   return &kernels_sse2;
+  case EM_ISA_AVX2:   return &kernels_avx2;
+  case EM_ISA_AVX512: return &kernels_avx512;
+  default:            return NULL;
+  }
+}
+
+#else  // other targets: one build at the compiler's baseline width
+
+static inline float sqrt_lane(float x) { return sqrtf(x); }
+#define ISA    generic
+#define ISA_ID EM_ISA_SSE2
+#define VBYTES 16
+#define VSQRT(v) __extension__({ __typeof__(v) r_ = (v); \
+    for (int k_ = 0; k_ < VW; k_++) r_[k_] = sqrt_lane(r_[k_]); r_; })
+#include "kernels_isa.h"
+#undef ISA
+#undef ISA_ID
+#undef VBYTES
+#undef VSQRT
+
+static int isa_usable(int isa) { return isa == EM_ISA_SSE2; }
+static const KernelSet *isa_set(int isa) { return isa == EM_ISA_SSE2 ? &kernels_generic : NULL; }
+
+#endif
+
+const KernelSet *kernel_set(int isa) {
+  if (isa == EM_ISA_AUTO) {
+    for (isa = EM_ISA_AVX512; isa > EM_ISA_SSE2 && !isa_usable(isa); isa--) {}
+  }
+  return isa_usable(isa) ? isa_set(isa) : NULL;
+}
@@ -0,0 +1,1120 @@
+// libematrix: particle system and color model (see ematrix.h).
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ematrix.h"
+#include "kernels.h"
+#include "workers.h"
+
+#define SCALE        0.76f  // matches your equation (· 0.76)
+#define RADIUS_MULT  2.0f   // increase/decrease overall swirl radius
+#define X_MULT       2.0f   // horizontal stretch (increase for more left/right motion)
+#define Y_MULT       1.0f   // vertical stretch
+#define SPEED        1.35f  // tweak swirl speed
+#define MIN_R        3.0f   // respawn when near center
+
+// The eigenbasis kernel's epoch moves up every this many seconds, which
+// keeps |w| under about e^{SPEED * EIGEN_REBASE_S / 2}.
+#define EIGEN_REBASE_S 16.0
+
+// Event-driven mode: a timing wheel of WHEEL_SLOTS slots, WHEEL_DT seconds
+// each. Wake-ups further out than the wheel reaches are clamped to its
+// last slot and simply re-predicted then.
+#define WHEEL_SLOTS  1024
+#define WHEEL_DT     (1.0 / 256.0)
+#define MUTATE_MEAN  ((float)MUTATE_ODDS / 200.0f)  // the per-frame odds at 200 fps, in seconds
+#define GREEN_STEPS  16
+#define SQRT3        1.7320508075688772f
+#define SQRT6        2.4494897427831781f  // largest singular value of P
+
+// Compact particles are decoded this many at a time into stack buffers.
+#define DECODE_CHUNK 256
+
+// cfg.sort: every SORT_FRAMES updates the particles are reordered by the
+// TILE_W x TILE_H screen tile they were last drawn on. Particles drift
+// across a tile in tens of frames, so a counting sort that often keeps
+// compose's cell writes within a few rows of each other for a fraction of
+// a pass per frame.
+#define SORT_FRAMES 32
+#define TILE_W      32
+#define TILE_H      8
+
+// cfg.threads: the particles are split into one contiguous slice per
+// thread. A slice's update fills its own stretch of draw[] and dead[]
+// (starting at its first particle, so slices never overlap) and then bins
+// those draws by band of TILE_H screen rows into draw_band[]. Compose runs
+// a band per task, taking every slice's draws for it in slice order: the
+// particle order of a serial compose, so exactly the same frame.
+typedef struct {
+  int lo, hi;         // particles [lo, hi)
+  int ndraw, ndead;   // at draw + lo and dead + lo
+  int *band;          // threads > 1: nbands + 1 offsets into draw_band + lo
+} Slice;
+
+// Video wall arena (em_wall_format()): a WallArena, then the particles,
+// then one Draw per particle, each part WALL_ALIGN aligned. Shard s owns
+// particles [n * s / nshards, n * (s + 1) / nshards) and the same stretch
+// of the draws, just as a slice does, and its WallShard keeps what an
+// ordinary context carries from one update to the next, so any process
+// can pick a shard up where another left it.
+#define WALL_MAGIC 0x31766c6c61776d65ULL  // "emwallv1"
+#define WALL_ALIGN 64
+
+typedef struct {
+  uint64_t rng;       // respawn positions
+  double eig_epoch;   // EM_KERNEL_EIGEN: E for the shard's particles
+  uint32_t frame;     // updates so far, the counter for ctr_rand()
+  float now;          // the last update's clock
+  int ndraw;          // draws at draw + the shard's first particle
+} WallShard;
+
+typedef struct {
+  uint64_t magic;
+  int rows, cols;     // the canvas
+  int n, nshards;
+  unsigned seed;
+  int compact, kernel, precision;
+  size_t particles, draws;  // offsets from the arena
+  WallShard shard[];
+} WallArena;
+
+struct em_ctx {
+  em_config cfg;
+  int rows, cols;
+  int n;              // particle count, fixed at creation
+  Particle *p;        // n entries, or NULL in compact mode
+  ParticleC *pc;      // n entries in compact mode
+  void *sort_buf;     // cfg.sort: n more, the other half of a sort
+  int *sort_key;      // n: tile of each particle, tiles_x * tiles_y when none
+  int *tile_start;    // tiles_x * tiles_y + 2 counters (the last for no tile)
+  int tiles_x, tiles_y;
+  Draw *draw;         // n entries
+  int ndraw;          // in all slices
+  int *dead;          // n entries: particles to respawn this step
+  int ndead;
+  Workers *pool;      // threads > 1: cfg.workers, or our own
+  Slice *slice;       // nslices
+  int nslices;
+  Draw *draw_band;    // threads > 1: n entries, each slice's draws by band
+  int *band_start;    // threads > 1: nslices * (nbands + 1), see Slice.band
+  int *band_overdraw; // threads > 1: nbands
+  int nbands, bands_cap;
+  cplx eig_f;         // EM_KERNEL_EIGEN: this frame's factor
+  int overdraw;
+  em_cell *cells;     // rows * cols, capacity cells_cap
+  int cells_cap;
+  uint64_t rng;       // respawn positions, drawn in order
+  uint64_t key[2];    // ctr_rand() keys: glyph mutation, black-hole look
+  uint32_t frame;     // em_update() count, the counter for ctr_rand()
+  double epoch;       // caller time of the first step
+  int started;
+  float now;          // seconds since epoch
+  uint16_t tick;      // compact mode clock, PC_TICK_HZ
+  double eig_epoch;   // EM_KERNEL_EIGEN: E, in seconds since epoch
+  int bh_mode;
+  const KernelSet *ks;  // SIMD kernels for cfg.isa
+
+  // Event-driven mode (cfg.events), see update_events(). cells persist
+  // between frames and only particles whose cell or look can have changed
+  // are touched.
+  int *ev_cell;       // n: cell each particle is on, -1 for none
+  int *ev_next;       // n: next particle in the same wheel slot
+  int *ev_prev_on, *ev_next_on;  // n: neighbours on the same cell
+  float *ev_mutate;   // n: time of the next glyph mutation
+  int *wheel;         // WHEEL_SLOTS list heads
+  int64_t wheel_pos;  // next slot to run
+  int *occ;           // cells_cap: first particle on each cell, -1 for none
+  int ev_valid;       // cells, occ and the wheel are in step with p
+  int nvisible, nupdated;
+  float green_step[GREEN_STEPS];  // ages where the green look changes
+  int ngreen_steps;
+
+  // Video wall (em_wall_attach()): p, pc and draw point into the arena,
+  // rows x cols is the whole canvas and cells hold the viewport.
+  WallArena *wall;
+  WallShard *wall_shard;  // NULL: compose only
+  int view_y, view_x, view_rows, view_cols;
+  Draw *view_draw;    // n: the draws on the viewport, moved onto its cells
+  int nview;
+};
+
+unsigned char em_tc_index(float hue, float level) {
+  int h = (int)(hue * (float)EM_TC_HUES);
+  int l = (int)(level * (float)(EM_TC_LEVELS - 1) + 0.5f);
+  if (h < 0) h = 0;
+  if (h >= EM_TC_HUES) h = EM_TC_HUES - 1;
+  if (l < 0) l = 0;
+  if (l >= EM_TC_LEVELS) l = EM_TC_LEVELS - 1;
+  return (unsigned char)(1 + h * EM_TC_LEVELS + l);
+}
+
+unsigned char em_tc_white(float level) {
+  int l = (int)(level * (float)(EM_TC_WHITES - 1) + 0.5f);
+  if (l < 0) l = 0;
+  if (l >= EM_TC_WHITES) l = EM_TC_WHITES - 1;
+  return (unsigned char)(1 + EM_TC_HUES * EM_TC_LEVELS + l);
+}
+
+// The look of a cell outside black-hole mode: plain glyphs, or green
+// brightening with age.
+static inline void plain_look(const em_ctx *c, em_cell *cell, char ch, float age) {
+  cell->ch = ch;
+  cell->prio = EM_PRIO_CHANGE;
+  if (!c->cfg.colors) {
+    cell->pair = 0;
+    cell->attr = 0;
+    cell->tc = 0;
+    return;
+  }
+  // Original "matrix green" vibe
+  float a = fminf(age / 2.0f, 1.0f);
+  cell->pair = (unsigned char)c->cfg.green_pair;
+  cell->attr = (a > 0.66f) ? EM_BOLD : 0;
+  cell->tc = c->cfg.truecolor ? em_tc_index(1.0f / 3.0f, 0.25f + 0.75f * a) : 0;
+}
+
+// Ages at which plain_look() changes, found by sampling: the look is
+// constant from age 2 on.
+static void find_green_steps(em_ctx *c) {
+  em_cell prev, cur;
+  plain_look(c, &prev, 'x', 0.0f);
+  c->ngreen_steps = 0;
+  for (int k = 1; k <= 2 * 1024 && c->ngreen_steps < GREEN_STEPS; k++) {
+    float age = (float)k / 1024.0f;
+    plain_look(c, &cur, 'x', age);
+    if (cur.attr != prev.attr || cur.tc != prev.tc) c->green_step[c->ngreen_steps++] = age;
+    prev = cur;
+  }
+}
+
+void em_config_default(em_config *cfg) {
+  memset(cfg, 0, sizeof(*cfg));
+  cfg->colors = 1;
+  cfg->green_pair = 1;
+  cfg->bh_pair_base = 20;
+  cfg->bh_pair_count = 9;
+}
+
+static int particle_count(const em_config *cfg, int rows, int cols) {
+  // Particle count: tweak for density
+  int n = cfg->particles > 0 ? cfg->particles : (rows * cols) / 20;
+  if (cfg->particles <= 0 && n < 200) n = 200;
+  return n;
+}
+
+// A context with cfg's settings, kernels and random keys, nothing else
+// allocated yet.
+static em_ctx *ctx_new(const em_config *cfg, unsigned seed) {
+  em_ctx *c = (em_ctx *)calloc(1, sizeof(*c));
+  if (!c) return NULL;
+  c->cfg = *cfg;
+  if (c->cfg.bh_pair_count < 1) c->cfg.bh_pair_count = 1;
+  if (c->cfg.compact) c->cfg.events = 0;
+  if (c->cfg.events) c->cfg.sort = 0;
+  if (c->cfg.events) c->cfg.kernel = EM_KERNEL_EIGEN;
+  c->ks = kernel_set(c->cfg.isa);
+  if (!c->ks) {
+    free(c);
+    return NULL;
+  }
+
+  c->rng = 0x9E3779B97F4A7C15ULL ^ (uint64_t)seed;
+  if (!c->rng) c->rng = 1;
+  c->key[0] = mix64((uint64_t)seed);
+  c->key[1] = mix64(c->key[0]);
+
+  if (c->cfg.compact || c->cfg.kernel == EM_KERNEL_LUT) expA_lut_init();
+  return c;
+}
+
+em_ctx *em_create(const em_config *cfg, int rows, int cols) {
+  if (rows <= 0 || cols <= 0) return NULL;
+  em_ctx *c = ctx_new(cfg, cfg->seed ? cfg->seed : (unsigned)time(NULL));
+  if (!c) return NULL;
+  c->n = particle_count(cfg, rows, cols);
+
+  if (cfg->compact) {
+    c->pc = (ParticleC *)calloc((size_t)c->n, sizeof(ParticleC));
+  } else {
+    c->p = (Particle *)calloc((size_t)c->n, sizeof(Particle));
+  }
+  c->draw = (Draw *)malloc((size_t)c->n * sizeof(Draw));
+  c->dead = (int *)malloc((size_t)c->n * sizeof(int));
+  c->nslices = c->cfg.threads > 1 ? c->cfg.threads : 1;
+  if (c->nslices > c->n) c->nslices = c->n;
+  c->slice = (Slice *)calloc((size_t)c->nslices, sizeof(Slice));
+  if (!c->slice) {
+    em_destroy(c);
+    return NULL;
+  }
+  for (int s = 0; s < c->nslices; s++) {
+    c->slice[s].lo = (int)((int64_t)c->n * s / c->nslices);
+    c->slice[s].hi = (int)((int64_t)c->n * (s + 1) / c->nslices);
+  }
+  if (c->nslices > 1) {
+    c->pool = c->cfg.workers ? c->cfg.workers : workers_create(c->nslices);
+    c->draw_band = (Draw *)malloc((size_t)c->n * sizeof(Draw));
+    if (!c->pool || !c->draw_band) {
+      em_destroy(c);
+      return NULL;
+    }
+  }
+  if (c->cfg.sort) {
+    c->sort_buf = malloc((size_t)c->n * (c->pc ? sizeof(ParticleC) : sizeof(Particle)));
+    c->sort_key = (int *)malloc((size_t)c->n * sizeof(int));
+    if (!c->sort_buf || !c->sort_key) {
+      em_destroy(c);
+      return NULL;
+    }
+  }
+  if (c->cfg.events) {
+    c->ev_cell = (int *)malloc((size_t)c->n * sizeof(int));
+    c->ev_next = (int *)malloc((size_t)c->n * sizeof(int));
+    c->ev_prev_on = (int *)malloc((size_t)c->n * sizeof(int));
+    c->ev_next_on = (int *)malloc((size_t)c->n * sizeof(int));
+    c->ev_mutate = (float *)malloc((size_t)c->n * sizeof(float));
+    c->wheel = (int *)malloc(WHEEL_SLOTS * sizeof(int));
+    if (!c->ev_cell || !c->ev_next || !c->ev_prev_on || !c->ev_next_on ||
+        !c->ev_mutate || !c->wheel) {
+      em_destroy(c);
+      return NULL;
+    }
+    find_green_steps(c);
+  }
+  if ((!c->p && !c->pc) || !c->draw || !c->dead || em_resize(c, rows, cols) < 0) {
+    em_destroy(c);
+    return NULL;
+  }
+  return c;
+}
+
+void em_destroy(em_ctx *c) {
+  if (!c) return;
+  if (!c->wall) {
+    free(c->p);
+    free(c->pc);
+    free(c->draw);
+  }
+  free(c->view_draw);
+  free(c->sort_buf);
+  free(c->sort_key);
+  free(c->tile_start);
+  if (c->pool != c->cfg.workers) workers_destroy(c->pool);
+  free(c->slice);
+  free(c->draw_band);
+  free(c->band_start);
+  free(c->band_overdraw);
+  free(c->dead);
+  free(c->cells);
+  free(c->ev_cell);
+  free(c->ev_next);
+  free(c->ev_prev_on);
+  free(c->ev_next_on);
+  free(c->ev_mutate);
+  free(c->wheel);
+  free(c->occ);
+  free(c);
+}
+
+// Respawn the first n particles listed in c->dead.
+static void respawn(em_ctx *c, int n) {
+  if (c->pc)
+    respawn_compact(c->pc, c->dead, n, c->rows, c->cols, c->tick, RADIUS_MULT * SCALE, &c->rng);
+  else
+    respawn_batch(c->p, c->dead, n, c->rows, c->cols, c->now, &c->rng);
+  if (c->p && c->cfg.kernel == EM_KERNEL_EIGEN) {
+    cplx g = eigen_factor(-SPEED * ((double)c->now - c->eig_epoch));
+    g.re *= RADIUS_MULT * SCALE;
+    g.im *= RADIUS_MULT * SCALE;
+    eigen_from_xy(c->p, c->dead, n, g);
+  }
+}
+
+static void clear_draws(em_ctx *c) {
+  c->ndraw = 0;
+  for (int s = 0; s < c->nslices; s++) c->slice[s].ndraw = 0;
+}
+
+int em_resize(em_ctx *c, int rows, int cols) {
+  if (rows <= 0 || cols <= 0) return -1;
+  if (rows * cols > c->cells_cap) {
+    em_cell *cells = (em_cell *)malloc((size_t)rows * (size_t)cols * sizeof(em_cell));
+    int *occ = c->cfg.events ? (int *)malloc((size_t)rows * (size_t)cols * sizeof(int)) : NULL;
+    if (!cells || (c->cfg.events && !occ)) {
+      free(cells);
+      free(occ);
+      return -1;
+    }
+    free(c->cells);
+    free(c->occ);
+    c->cells = cells;
+    c->occ = occ;
+    c->cells_cap = rows * cols;
+  }
+  if (c->wall) {
+    // The canvas is fixed; only the viewport changes.
+    c->view_rows = rows;
+    c->view_cols = cols;
+    c->nview = 0;
+    memset(c->cells, 0, (size_t)rows * (size_t)cols * sizeof(em_cell));
+    return 0;
+  }
+  if (c->cfg.sort) {
+    int tx = (cols + TILE_W - 1) / TILE_W, ty = (rows + TILE_H - 1) / TILE_H;
+    if (tx * ty > c->tiles_x * c->tiles_y) {
+      int *ts = (int *)malloc((size_t)(tx * ty + 2) * sizeof(int));
+      if (!ts) return -1;
+      free(c->tile_start);
+      c->tile_start = ts;
+    }
+    c->tiles_x = tx;
+    c->tiles_y = ty;
+  }
+  if (c->pool) {
+    int nb = (rows + TILE_H - 1) / TILE_H;
+    if (nb > c->bands_cap) {
+      int *bs = (int *)malloc((size_t)c->nslices * (size_t)(nb + 1) * sizeof(int));
+      int *bo = (int *)malloc((size_t)nb * sizeof(int));
+      if (!bs || !bo) {
+        free(bs);
+        free(bo);
+        return -1;
+      }
+      free(c->band_start);
+      free(c->band_overdraw);
+      c->band_start = bs;
+      c->band_overdraw = bo;
+      c->bands_cap = nb;
+    }
+    c->nbands = nb;
+    for (int s = 0; s < c->nslices; s++) c->slice[s].band = c->band_start + s * (nb + 1);
+  }
+  c->ev_valid = 0;
+  clear_draws(c);  // the draw lists are for the old size
+  c->rows = rows;
+  c->cols = cols;
+  memset(c->cells, 0, (size_t)rows * (size_t)cols * sizeof(em_cell));
+  for (int i = 0; i < c->n; i++) c->dead[i] = i;
+  respawn(c, c->n);
+  return 0;
+}
+
+void em_set_mode(em_ctx *c, int bh_mode) { c->bh_mode = bh_mode != 0; }
+int  em_mode(const em_ctx *c) { return c->bh_mode; }
+
+const em_cell *em_cells(const em_ctx *c, int *rows, int *cols) {
+  if (rows) *rows = c->wall ? c->view_rows : c->rows;
+  if (cols) *cols = c->wall ? c->view_cols : c->cols;
+  return c->cells;
+}
+
+// Chunk of particle positions on their way through binning.
+typedef struct {
+  float vx[DECODE_CHUNK], vy[DECODE_CHUNK], r[DECODE_CHUNK];
+  int cell[DECODE_CHUNK];
+} Chunk;
+
+// Map positions k.vx/vy to cells (k.cell, -1 once a particle is near the
+// center or off-screen) and distances from the center (k.r).
+static inline void bin_chunk(em_ctx *c, Chunk *k, int m) {
+  BinGeom g = {(c->cols - 1) * 0.5f, (c->rows - 1) * 0.5f, X_MULT, Y_MULT, MIN_R,
+               c->rows, c->cols};
+  c->ks->bin(k->vx, k->vy, m, &g, k->cell, k->r);
+}
+
+// Particle i's random bits for this frame, from one of two independent
+// streams.
+enum { RAND_MUTATE, RAND_LOOK };
+
+static inline uint64_t frame_rand(const em_ctx *c, int stream, int i) {
+  return ctr_rand(c->key[stream], (uint32_t)i, c->frame);
+}
+
+// Count down to particle i's next glyph mutation (see mutate_skip()):
+// nothing but a decrement and compare until it is due.
+static inline void mutate_particle(const em_ctx *c, Particle *q, int i) {
+  if (--q->mutate) return;
+  uint64_t h = frame_rand(c, RAND_MUTATE, i);
+  q->ch = glyph_set[(uint32_t)(h >> 32) % GLYPH_COUNT];
+  q->mutate = (uint16_t)mutate_skip((uint32_t)h);
+}
+
+static inline void mutate_compact(const em_ctx *c, ParticleC *q, int i) {
+  if (--q->mutate) return;
+  uint64_t h = frame_rand(c, RAND_MUTATE, i);
+  unsigned skip = mutate_skip((uint32_t)h);
+  q->glyph = (uint8_t)((uint32_t)(h >> 32) % GLYPH_COUNT);
+  q->mutate = (uint8_t)(skip < 255 ? skip : 255);
+}
+
+// Queue particle i (entry j of a binned chunk) on its slice for drawing,
+// or for respawn (returning NULL) when it fell off its cell.
+static inline Draw *place(em_ctx *c, Slice *sl, int i, const Chunk *k, int j, float age) {
+  if (k->cell[j] < 0) {
+    c->dead[sl->lo + sl->ndead++] = i;
+    return NULL;
+  }
+  Draw *d = &c->draw[sl->lo + sl->ndraw++];
+  d->cell = k->cell[j];
+  d->idx = i;
+  d->vx = k->vx[j];
+  d->vy = k->vy[j];
+  d->r = k->r[j];
+  d->age = age;
+  return d;
+}
+
+// Stable counting sort of the particles by the tile of the cell the last
+// update drew them on; those it didn't draw go last. Runs before an
+// update, so the draw list it reads is rebuilt right after.
+static void sort_particles(em_ctx *c) {
+  int ntiles = c->tiles_x * c->tiles_y;
+  int *start = c->tile_start, *key = c->sort_key;
+  for (int i = 0; i < c->n; i++) key[i] = ntiles;
+  for (int s = 0; s < c->nslices; s++)
+    for (int j = 0; j < c->slice[s].ndraw; j++) {
+      const Draw *d = &c->draw[c->slice[s].lo + j];
+      int y = d->cell / c->cols, x = d->cell - y * c->cols;
+      key[d->idx] = (y / TILE_H) * c->tiles_x + x / TILE_W;
+    }
+
+  memset(start, 0, (size_t)(ntiles + 2) * sizeof(int));
+  for (int i = 0; i < c->n; i++) start[key[i] + 1]++;
+  for (int t = 1; t < ntiles + 2; t++) start[t] += start[t - 1];
+  // start[k] is now where tile k begins; the scatter advances it.
+  if (c->pc) {
+    ParticleC *out = (ParticleC *)c->sort_buf;
+    for (int i = 0; i < c->n; i++) out[start[key[i]]++] = c->pc[i];
+    c->sort_buf = c->pc;
+    c->pc = out;
+  } else {
+    Particle *out = (Particle *)c->sort_buf;
+    for (int i = 0; i < c->n; i++) out[start[key[i]]++] = c->p[i];
+    c->sort_buf = c->p;
+    c->p = out;
+  }
+}
+
+static void update_particles(em_ctx *c, Slice *sl) {
+  // The polynomial variants vectorize; libm and the tables stay scalar.
+  int vec = c->cfg.kernel == EM_KERNEL_EXPA && c->cfg.precision != EM_PRECISION_EXACT;
+  void (*expm)(float, float[2][2]) = c->cfg.kernel == EM_KERNEL_LUT ? expA_lut : expA;
+  Chunk k;
+  float tnow = c->now;
+  for (int base = sl->lo; base < sl->hi; base += DECODE_CHUNK) {
+    int m = sl->hi - base < DECODE_CHUNK ? sl->hi - base : DECODE_CHUNK;
+    Particle *p = c->p + base;
+    if (vec) {
+      c->ks->expa_positions(p, m, tnow, SPEED, RADIUS_MULT * SCALE,
+                            c->cfg.precision == EM_PRECISION_FAST, k.vx, k.vy);
+    } else {
+      for (int j = 0; j < m; j++) {
+        float M[2][2];
+        expm((tnow - p[j].born) * SPEED, M);
+        k.vx[j] = RADIUS_MULT * SCALE * (M[0][0] * p[j].vx0 + M[0][1] * p[j].vy0);
+        k.vy[j] = RADIUS_MULT * SCALE * (M[1][0] * p[j].vx0 + M[1][1] * p[j].vy0);
+      }
+    }
+    bin_chunk(c, &k, m);
+    for (int j = 0; j < m; j++) {
+      Draw *d = place(c, sl, base + j, &k, j, (tnow - p[j].born) * SPEED);
+      if (!d) continue;
+
+      // Occasionally mutate character for that "matrix" vibe
+      mutate_particle(c, &p[j], base + j);
+      d->ch = p[j].ch;
+    }
+  }
+}
+
+static void update_compact(em_ctx *c, Slice *sl) {
+  Chunk k;
+  const float tick_age = SPEED / (float)PC_TICK_HZ;
+  for (int base = sl->lo; base < sl->hi; base += DECODE_CHUNK) {
+    int m = sl->hi - base < DECODE_CHUNK ? sl->hi - base : DECODE_CHUNK;
+    ParticleC *pc = c->pc + base;
+    c->ks->decode_compact(pc, m, c->tick, SPEED, k.vx, k.vy);
+    bin_chunk(c, &k, m);
+    for (int j = 0; j < m; j++) {
+      float age = (float)(uint16_t)(c->tick - pc[j].born) * tick_age;
+      Draw *d = place(c, sl, base + j, &k, j, age);
+      if (!d) continue;
+      mutate_compact(c, &pc[j], base + j);
+      d->ch = glyph_char(pc[j].glyph);
+    }
+  }
+}
+
+// This frame's shared eigenbasis factor, rebasing the context's particles
+// (a wall shard's only) first when due.
+static cplx eigen_frame(em_ctx *c) {
+  if ((double)c->now - c->eig_epoch > EIGEN_REBASE_S) {
+    int lo = c->slice[0].lo, hi = c->slice[c->nslices - 1].hi;
+    eigen_rebase(c->p + lo, hi - lo, eigen_factor(SPEED * ((double)c->now - c->eig_epoch)));
+    c->eig_epoch = c->now;
+  }
+  return eigen_factor(SPEED * ((double)c->now - c->eig_epoch));
+}
+
+// Uses c->eig_f, which em_update() sets from eigen_frame() beforehand.
+static void update_eigen(em_ctx *c, Slice *sl) {
+  Chunk k;
+  float tnow = c->now;
+  for (int base = sl->lo; base < sl->hi; base += DECODE_CHUNK) {
+    int m = sl->hi - base < DECODE_CHUNK ? sl->hi - base : DECODE_CHUNK;
+    Particle *p = c->p + base;
+    c->ks->eigen_positions(p, m, c->eig_f, k.vx, k.vy);
+    bin_chunk(c, &k, m);
+    for (int j = 0; j < m; j++) {
+      Draw *d = place(c, sl, base + j, &k, j, (tnow - p[j].born) * SPEED);
+      if (!d) continue;
+      mutate_particle(c, &p[j], base + j);
+      d->ch = p[j].ch;
+    }
+  }
+}
+
+// Stable counting sort of a slice's draws by band into draw_band, leaving
+// sl->band[b] where band b starts.
+static void bin_bands(em_ctx *c, Slice *sl) {
+  int *bs = sl->band, band_cells = c->cols * TILE_H;
+  const Draw *d = c->draw + sl->lo;
+  Draw *out = c->draw_band + sl->lo;
+  memset(bs, 0, (size_t)(c->nbands + 1) * sizeof(int));
+  for (int j = 0; j < sl->ndraw; j++) bs[d[j].cell / band_cells + 1]++;
+  for (int b = 1; b <= c->nbands; b++) bs[b] += bs[b - 1];
+  for (int j = 0; j < sl->ndraw; j++) out[bs[d[j].cell / band_cells]++] = d[j];
+  // The scatter moved every start up to the next band's; shift them back.
+  memmove(bs + 1, bs, (size_t)c->nbands * sizeof(int));
+  bs[0] = 0;
+}
+
+static void update_slice(void *arg, int s) {
+  em_ctx *c = (em_ctx *)arg;
+  Slice *sl = &c->slice[s];
+  sl->ndraw = sl->ndead = 0;
+  if (c->pc)                                update_compact(c, sl);
+  else if (c->cfg.kernel == EM_KERNEL_EIGEN) update_eigen(c, sl);
+  else                                      update_particles(c, sl);
+  if (c->pool) bin_bands(c, sl);
+}
+
+// ---------------------------------------------------------------------------
+// Event-driven updates (green look only)
+//
+// A particle's cell can only change once its screen position has moved
+// past the nearest rounding boundary. Its eigenbasis coefficient decays,
+// |z(t)| <= |z(now)|, and the position is P z with z' = lambda z, so its
+// speed is at most SPEED * |P| * |z(now)| = SPEED * sqrt(6) * |z(now)|
+// (|lambda| = 1), and per axis at most twice SPEED * |z(now)|. Dividing
+// the distance to the boundary (or to MIN_R) by that bound gives the earliest time anything visible can change, and
+// the particle sleeps in the wheel until then, or until its next green
+// brightness step or glyph mutation. Each cell keeps a list of the
+// particles on it: when one leaves, the cell shows the next one, or is
+// cleared when it was the last.
+
+// Seconds to particle i's next glyph mutation, exponential with mean
+// MUTATE_MEAN, from h's low bits.
+static float mutate_wait(uint64_t h) {
+  float u = (float)(((uint32_t)h >> 8) + 1) * (1.0f / 16777216.0f);
+  return -logf(u) * MUTATE_MEAN;
+}
+
+static void wheel_insert(em_ctx *c, int i, int64_t slot) {
+  int *head = &c->wheel[slot & (WHEEL_SLOTS - 1)];
+  c->ev_next[i] = *head;
+  *head = i;
+}
+
+static void ev_leave(em_ctx *c, int i) {
+  int cell = c->ev_cell[i];
+  if (cell < 0) return;
+  int prev = c->ev_prev_on[i], next = c->ev_next_on[i];
+  if (prev >= 0) c->ev_next_on[prev] = next;
+  else           c->occ[cell] = next;
+  if (next >= 0) c->ev_prev_on[next] = prev;
+  c->ev_cell[i] = -1;
+  c->nvisible--;
+
+  int top = c->occ[cell];
+  if (top < 0) {
+    memset(&c->cells[cell], 0, sizeof(em_cell));
+    return;
+  }
+  c->overdraw--;
+  const Particle *q = &c->p[top];
+  plain_look(c, &c->cells[cell], q->ch, (c->now - q->born) * SPEED);
+}
+
+static void ev_enter(em_ctx *c, int i, int cell) {
+  int top = c->occ[cell];
+  if (top >= 0) {
+    c->ev_prev_on[top] = i;
+    c->overdraw++;
+  }
+  c->ev_next_on[i] = top;
+  c->ev_prev_on[i] = -1;
+  c->occ[cell] = i;
+  c->ev_cell[i] = cell;
+  c->nvisible++;
+}
+
+// Start over from the particles alone: every one is due this frame.
+static void ev_rebuild(em_ctx *c, int64_t now_slot) {
+  memset(c->cells, 0, (size_t)c->rows * (size_t)c->cols * sizeof(em_cell));
+  for (int k = 0; k < c->rows * c->cols; k++) c->occ[k] = -1;
+  for (int s = 0; s < WHEEL_SLOTS; s++) c->wheel[s] = -1;
+  for (int i = 0; i < c->n; i++) {
+    c->ev_cell[i] = -1;
+    c->ev_mutate[i] = c->now + mutate_wait(frame_rand(c, RAND_MUTATE, i));
+    wheel_insert(c, i, now_slot);
+  }
+  c->wheel_pos = now_slot;
+  c->overdraw = c->nvisible = 0;
+  c->ev_valid = 1;
+}
+
+static void ev_touch(em_ctx *c, int i, cplx f, int64_t now_slot) {
+  Particle *p = &c->p[i];
+  c->nupdated++;
+  cplx z = cplx_mul((cplx){p->vx0, p->vy0}, f);
+  float vx = 2.0f * z.re, vy = SQRT3 * z.im - z.re;
+  float px = (c->cols - 1) * 0.5f + X_MULT * vx;
+  float py = (c->rows - 1) * 0.5f + Y_MULT * vy;
+  float r = sqrtf(vx * vx + vy * vy);
+  int x = (int)lroundf(px);
+  int y = (int)lroundf(py);
+
+  if (r < MIN_R || x < 0 || x >= c->cols || y < 0 || y >= c->rows) {
+    ev_leave(c, i);
+    c->dead[c->ndead++] = i;
+    return;
+  }
+  int cell = y * c->cols + x;
+  if (cell != c->ev_cell[i]) {
+    ev_leave(c, i);
+    ev_enter(c, i, cell);
+  }
+  if (c->now >= c->ev_mutate[i]) {
+    uint64_t h = frame_rand(c, RAND_MUTATE, i);
+    p->ch = glyph_set[(uint32_t)(h >> 32) % GLYPH_COUNT];
+    c->ev_mutate[i] = c->now + mutate_wait(h);
+  }
+  float age = (c->now - p->born) * SPEED;
+  plain_look(c, &c->cells[cell], p->ch, age);
+
+  // Earliest time the cell, the look or the glyph can change. Each of
+  // x = 2 re and y = sqrt(3) im - re moves at most 2 |z'| = 2 |z|.
+  float zs = SPEED * sqrtf(z.re * z.re + z.im * z.im) + 1e-6f;
+  float wait = fminf((0.5f - fabsf(px - (float)x)) / (X_MULT * 2.0f * zs),
+                     (0.5f - fabsf(py - (float)y)) / (Y_MULT * 2.0f * zs));
+  wait = fminf(wait, (r - MIN_R) / (SQRT6 * zs));
+  for (int k = 0; k < c->ngreen_steps; k++)
+    if (c->green_step[k] > age) {
+      wait = fminf(wait, (c->green_step[k] - age) / SPEED);
+      break;
+    }
+  wait = fminf(wait, c->ev_mutate[i] - c->now);
+
+  int64_t slot = (int64_t)floor(((double)c->now + (double)wait) / WHEEL_DT);
+  if (slot <= now_slot) slot = now_slot + 1;
+  if (slot > now_slot + WHEEL_SLOTS - 1) slot = now_slot + WHEEL_SLOTS - 1;
+  wheel_insert(c, i, slot);
+}
+
+static void update_events(em_ctx *c) {
+  cplx f = eigen_frame(c);
+  int64_t now_slot = (int64_t)floor((double)c->now / WHEEL_DT);
+  // Resized, back from black-hole mode, or asleep longer than the wheel.
+  if (!c->ev_valid || now_slot - c->wheel_pos >= WHEEL_SLOTS) ev_rebuild(c, now_slot);
+
+  c->nupdated = 0;
+  for (; c->wheel_pos <= now_slot; c->wheel_pos++) {
+    int *head = &c->wheel[c->wheel_pos & (WHEEL_SLOTS - 1)];
+    int i = *head;
+    *head = -1;
+    while (i >= 0) {
+      int next = c->ev_next[i];
+      ev_touch(c, i, f, now_slot);
+      i = next;
+    }
+  }
+}
+
+// Respawned particles show up (or die again) on the next frame, as they
+// do when every particle is updated every frame.
+static void ev_respawned(em_ctx *c) {
+  int64_t next_slot = (int64_t)floor((double)c->now / WHEEL_DT) + 1;
+  for (int j = 0; j < c->ndead; j++) {
+    int i = c->dead[j];
+    c->ev_mutate[i] = c->now + mutate_wait(frame_rand(c, RAND_MUTATE, i));
+    wheel_insert(c, i, next_slot);
+  }
+}
+
+static int events_on(const em_ctx *c) {
+  return c->cfg.events && (!c->bh_mode || !c->cfg.colors);
+}
+
+void em_update(em_ctx *c, double t) {
+  WallShard *ws = c->wall_shard;
+  if (c->wall && !ws) return;
+  if (ws) {
+    c->rng = ws->rng;
+    c->frame = ws->frame;
+    c->eig_epoch = ws->eig_epoch;
+  }
+  if (!c->started) {
+    c->epoch = t;
+    c->started = 1;
+  }
+  c->now = (float)(t - c->epoch);
+  c->frame++;
+  c->tick = (uint16_t)(uint64_t)((t - c->epoch) * PC_TICK_HZ);
+
+  c->ndead = 0;
+  if (events_on(c)) {
+    clear_draws(c);
+    update_events(c);
+    respawn(c, c->ndead);
+    ev_respawned(c);
+    return;
+  }
+  c->ev_valid = 0;
+  if (c->cfg.sort && c->frame % SORT_FRAMES == 0) sort_particles(c);
+  if (c->p && c->cfg.kernel == EM_KERNEL_EIGEN) c->eig_f = eigen_frame(c);
+  workers_run(c->pool, "update slice", c->nslices, update_slice, c);
+  // Respawn in particle order, as a single slice would.
+  c->ndraw = 0;
+  for (int s = 0; s < c->nslices; s++) {
+    const Slice *sl = &c->slice[s];
+    memmove(c->dead + c->ndead, c->dead + sl->lo, (size_t)sl->ndead * sizeof(int));
+    c->ndead += sl->ndead;
+    c->ndraw += sl->ndraw;
+  }
+  respawn(c, c->ndead);
+  if (ws) {
+    ws->rng = c->rng;
+    ws->frame = c->frame;
+    ws->eig_epoch = c->eig_epoch;
+    ws->now = c->now;
+    ws->ndraw = c->ndraw;
+  }
+}
+
+// Draw n draws, in order, onto the (cleared) cells; returns how many
+// landed on a cell already drawn. Touches only the draws' own cells.
+static int compose_draws(const em_ctx *c, const Draw *draws, int n) {
+  const int BH_PAIR_BASE  = c->cfg.bh_pair_base;
+  const int BH_PAIR_COUNT = c->cfg.bh_pair_count;
+  const int truecolor = c->cfg.truecolor;
+  float cx = (c->cols - 1) * 0.5f;
+  float cy = (c->rows - 1) * 0.5f;
+  // Max visible radius in the *un-stretched* (vx,vy) space
+  float maxr_vis = fminf(cx / X_MULT, cy / Y_MULT);
+  float tnow = c->now;
+  int overdraw = 0;
+
+  // The continuous part of the black-hole look comes from the SIMD
+  // kernel a chunk at a time; the branchy rest stays scalar.
+  int bh = c->cfg.colors && c->bh_mode;
+  ShadeGeom sg = {SPEED, SPEED * (maxr_vis * 2.0f) + 1e-3f, maxr_vis + 1e-3f, 0.12f * tnow};
+  float swirl_v[DECODE_CHUNK], heat_v[DECODE_CHUNK], hue_v[DECODE_CHUNK];
+
+  // In particle order, so the last one on a cell wins.
+  for (int j = 0; j < n; j++) {
+    const Draw *d = &draws[j];
+    em_cell *cell = &c->cells[d->cell];
+    char ch = d->ch;
+    float r = d->r, age = d->age;
+    int jc = j % DECODE_CHUNK;
+    if (bh && jc == 0) {
+      int m = n - j < DECODE_CHUNK ? n - j : DECODE_CHUNK;
+      c->ks->bh_shade(d, m, &sg, swirl_v, heat_v, hue_v);
+    }
+
+    // Color/brightness
+    if (!bh) {
+      overdraw += cell->ch != 0;
+      plain_look(c, cell, ch, age);
+    } else {
+      // "Black hole" vibe: use BOTH radius and local speed (velocity) for color
+      // Position in (vx,vy) space (pre-stretch)
+      float shadow_r = 0.18f * maxr_vis;
+      float ring_r   = 0.32f * maxr_vis;
+      float ring_w   = 0.06f * maxr_vis;
+
+      // From bh_shade(), with the velocity w.r.t. real time v_dot = SPEED * A * v:
+      // "swirl" ~ angular-ish speed (varies with direction, not just radius),
+      // heat ~ how fast it's moving relative to the max visible radius, and
+      // a rainbow hue from time + radius + velocity, so it isn't just an
+      // "inward gradient".
+      float swirl_n = swirl_v[jc];
+      float heat = heat_v[jc];
+      float hue = hue_v[jc];
+      int rainbow_idx = (int)floorf(hue * (float)BH_PAIR_COUNT);
+      if (rainbow_idx < 0) rainbow_idx = 0;
+      if (rainbow_idx >= BH_PAIR_COUNT) rainbow_idx = BH_PAIR_COUNT - 1;
+      int rainbow_pair = BH_PAIR_BASE + rainbow_idx;
+
+      int pair = rainbow_pair;
+      int do_bold = 0;
+      int do_dim  = 0;
+      int do_blink = 0;
+      int draw_it = 1;
+      int white = 0;
+      float level = 0.5f; // truecolor brightness
+      // This particle's dice for the frame: bits 0-1 shadow, 2-8 twinkle,
+      // 32-63 sparkle.
+      uint64_t dice = frame_rand(c, RAND_LOOK, d->idx);
+
+      // Deep shadow: mostly empty/dim near the center
+      if (r < shadow_r) {
+        if ((dice & 3) != 0) {
+          draw_it = 0; // skip most chars to make a darker "shadow"
+        } else {
+          pair = BH_PAIR_BASE;
+          do_dim = 1;
+          level = 0.0f;
+        }
+      } else {
+        // Bright photon-ring-like band, thickness reacts to swirl
+        float ring_thick = ring_w * (0.6f + 0.8f * swirl_n);
+        if (fabsf(r - ring_r) < ring_thick) {
+          // Ring flashes between white-hot and rainbow depending on swirl/time
+          int white_pair = BH_PAIR_BASE + (BH_PAIR_COUNT - 1);
+          pair = (((int)(tnow * 14.0f) & 1) || swirl_n > 0.55f) ? white_pair : rainbow_pair;
+          white = pair == white_pair;
+          level = 1.0f;
+          do_bold = 1;
+          if (swirl_n > 0.75f) do_blink = 1;
+        } else {
+          // Disk color is rainbow_pair; intensity comes from velocity/"heat" and swirl
+          float t = 0.60f * heat + 0.40f * swirl_n;
+          pair = rainbow_pair;
+          level = t;
+
+          // Make it "flashy": occasional sparkles for fast-moving bits
+          if (t > 0.85f) {
+            do_bold = 1;
+            if ((uint32_t)(dice >> 32) % 10 == 0) {
+              pair = BH_PAIR_BASE + (BH_PAIR_COUNT - 1); // white sparkle
+              white = 1;
+              do_blink = 1;
+            }
+          } else if (t > 0.65f) {
+            do_bold = 1;
+          } else if (t < 0.25f) {
+            do_dim = 1;
+          }
+
+          // Rare global twinkle (keeps it lively)
+          if (((dice >> 2) & 127) == 0) {
+            pair = BH_PAIR_BASE + (BH_PAIR_COUNT - 1);
+            white = 1;
+            level = 1.0f;
+            do_bold = 1;
+            do_blink = 1;
+          }
+        }
+      }
+
+      if (draw_it) {
+        overdraw += cell->ch != 0;
+        cell->ch = ch;
+        cell->pair = (unsigned char)pair;
+        cell->attr = (unsigned char)((do_bold ? EM_BOLD : 0) |
+                                     (do_dim ? EM_DIM : 0) |
+                                     (do_blink ? EM_BLINK : 0));
+        // Bright ring and sparkle cells carry the look; spend on them first.
+        cell->prio = do_bold ? EM_PRIO_RING : EM_PRIO_CHANGE;
+        cell->tc = !truecolor ? 0 : white ? em_tc_white(level) : em_tc_index(hue, level);
+      }
+    }
+  }
+  return overdraw;
+}
+
+// One band of TILE_H rows: clear it, then every slice's draws on it.
+static void compose_band(void *arg, int b) {
+  em_ctx *c = (em_ctx *)arg;
+  int y1 = (b + 1) * TILE_H < c->rows ? (b + 1) * TILE_H : c->rows;
+  memset(c->cells + (size_t)b * TILE_H * c->cols, 0,
+         (size_t)(y1 - b * TILE_H) * (size_t)c->cols * sizeof(em_cell));
+  int overdraw = 0;
+  for (int s = 0; s < c->nslices; s++) {
+    const Slice *sl = &c->slice[s];
+    if (!sl->ndraw) continue;  // also: band offsets not filled in since a resize
+    overdraw += compose_draws(c, c->draw_band + sl->lo + sl->band[b],
+                              sl->band[b + 1] - sl->band[b]);
+  }
+  c->band_overdraw[b] = overdraw;
+}
+
+// Every shard's draws that land on the viewport, in particle order, moved
+// onto its cells.
+static void wall_gather(em_ctx *c) {
+  const WallArena *w = c->wall;
+  c->nview = 0;
+  for (int s = 0; s < w->nshards; s++) {
+    const Draw *d = c->draw + (int)((int64_t)w->n * s / w->nshards);
+    for (int j = 0; j < w->shard[s].ndraw; j++) {
+      int y = d[j].cell / c->cols, x = d[j].cell - y * c->cols;
+      y -= c->view_y;
+      x -= c->view_x;
+      if ((unsigned)y >= (unsigned)c->view_rows || (unsigned)x >= (unsigned)c->view_cols)
+        continue;
+      Draw *v = &c->view_draw[c->nview++];
+      *v = d[j];
+      v->cell = y * c->view_cols + x;
+    }
+  }
+}
+
+void em_compose(em_ctx *c) {
+  if (c->wall) {
+    // The look's clock and dice are the frame's, whoever updated it.
+    c->now = c->wall->shard[0].now;
+    c->frame = c->wall->shard[0].frame;
+    wall_gather(c);
+    memset(c->cells, 0, (size_t)c->view_rows * (size_t)c->view_cols * sizeof(em_cell));
+    c->overdraw = compose_draws(c, c->view_draw, c->nview);
+    return;
+  }
+  // Event-driven updates keep the cells current themselves.
+  if (events_on(c) && c->ev_valid) return;
+  c->ev_valid = 0;
+
+  if (c->pool) {
+    workers_run(c->pool, "compose band", c->nbands, compose_band, c);
+    c->overdraw = 0;
+    for (int b = 0; b < c->nbands; b++) c->overdraw += c->band_overdraw[b];
+    return;
+  }
+  // Clear each frame (simple "cmatrix-like" refresh)
+  memset(c->cells, 0, (size_t)c->rows * (size_t)c->cols * sizeof(em_cell));
+  c->overdraw = compose_draws(c, c->draw, c->ndraw);
+}
+
+void em_get_stats(const em_ctx *c, em_stats *st) {
+  int ev = events_on(c) && c->ev_valid;
+  st->particles = c->n;
+  st->visible = ev ? c->nvisible : c->wall ? c->nview : c->ndraw;
+  st->respawns = c->ndead;
+  st->overdraw = c->overdraw;
+  // A wall context updates its shard's slice, or nothing if it only composes.
+  st->updated = ev ? c->nupdated : !c->wall ? c->n
+              : c->wall_shard ? c->slice[0].hi - c->slice[0].lo : 0;
+  st->isa = c->ks->isa;
+}
+
+int em_isa_supported(int isa) {
+  return kernel_set(isa) != NULL;
+}
+
+void em_step(em_ctx *c, double t) {
+  em_update(c, t);
+  em_compose(c);
+}
+
+// ---------------------------------------------------------------------------
+// Video wall
+
+static size_t wall_align(size_t n) {
+  return (n + WALL_ALIGN - 1) & ~(size_t)(WALL_ALIGN - 1);
+}
+
+static size_t particle_size(const em_config *cfg) {
+  return cfg->compact ? sizeof(ParticleC) : sizeof(Particle);
+}
+
+size_t em_wall_size(const em_config *cfg, int rows, int cols, int nshards) {
+  if (rows <= 0 || cols <= 0 || nshards <= 0) return 0;
+  size_t n = (size_t)particle_count(cfg, rows, cols);
+  if ((size_t)nshards > n) return 0;
+  return wall_align(sizeof(WallArena) + (size_t)nshards * sizeof(WallShard)) +
+         wall_align(n * particle_size(cfg)) + n * sizeof(Draw);
+}
+
+int em_wall_format(void *arena, const em_config *cfg, int rows, int cols, int nshards) {
+  if (!em_wall_size(cfg, rows, cols, nshards)) return -1;
+  WallArena *w = (WallArena *)arena;
+  w->rows = rows;
+  w->cols = cols;
+  w->n = particle_count(cfg, rows, cols);
+  w->nshards = nshards;
+  w->seed = cfg->seed ? cfg->seed : (unsigned)time(NULL);
+  w->compact = cfg->compact != 0;
+  w->kernel = cfg->kernel;
+  w->precision = cfg->precision;
+  w->particles = wall_align(sizeof(WallArena) + (size_t)nshards * sizeof(WallShard));
+  w->draws = w->particles + wall_align((size_t)w->n * particle_size(cfg));
+  w->magic = WALL_MAGIC;
+
+  // Spawn everything at t = 0 from the arena's seed, then give each shard
+  // a respawn stream of its own.
+  em_ctx *c = em_wall_attach(arena, cfg, -1, 0, 0, 1, 1);
+  if (!c) {
+    w->magic = 0;
+    return -1;
+  }
+  for (int i = 0; i < c->n; i++) c->dead[i] = i;
+  respawn(c, c->n);
+  for (int s = 0; s < nshards; s++) {
+    w->shard[s].rng = mix64(c->rng + (uint64_t)s);
+    if (!w->shard[s].rng) w->shard[s].rng = 1;
+    w->shard[s].eig_epoch = 0.0;
+    w->shard[s].frame = 0;
+    w->shard[s].now = 0.0f;
+    w->shard[s].ndraw = 0;
+  }
+  em_destroy(c);
+  return 0;
+}
+
+em_ctx *em_wall_attach(void *arena, const em_config *cfg, int shard, int y, int x,
+                       int rows, int cols) {
+  WallArena *w = (WallArena *)arena;
+  if (w->magic != WALL_MAGIC || shard < -1 || shard >= w->nshards || rows <= 0 || cols <= 0)
+    return NULL;
+  // The simulation is the arena's; the look is this context's own.
+  em_config wc = *cfg;
+  wc.particles = w->n;
+  wc.compact = w->compact;
+  wc.kernel = w->kernel;
+  wc.precision = w->precision;
+  wc.events = 0;
+  wc.sort = 0;
+  wc.threads = 1;
+  em_ctx *c = ctx_new(&wc, w->seed);
+  if (!c) return NULL;
+  c->wall = w;
+  c->n = w->n;
+  c->rows = w->rows;
+  c->cols = w->cols;
+  c->started = 1;  // t counts from em_wall_format()
+  if (c->cfg.compact) c->pc = (ParticleC *)((char *)arena + w->particles);
+  else                c->p = (Particle *)((char *)arena + w->particles);
+  c->draw = (Draw *)((char *)arena + w->draws);
+  c->view_y = y;
+  c->view_x = x;
+
+  c->nslices = 1;
+  c->slice = (Slice *)calloc(1, sizeof(Slice));
+  c->dead = (int *)malloc((size_t)c->n * sizeof(int));
+  c->view_draw = (Draw *)malloc((size_t)c->n * sizeof(Draw));
+  if (!c->slice || !c->dead || !c->view_draw || em_resize(c, rows, cols) < 0) {
+    em_destroy(c);
+    return NULL;
+  }
+  if (shard >= 0) {
+    c->wall_shard = &w->shard[shard];
+    c->slice[0].lo = (int)((int64_t)w->n * shard / w->nshards);
+    c->slice[0].hi = (int)((int64_t)w->n * (shard + 1) / w->nshards);
+  }
+  return c;
+}
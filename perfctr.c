@@ -0,0 +1,146 @@
+// perf_event_open counters for the frame stages (see perfctr.h).
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "perfctr.h"
+
+#define CACHE_MISS(cache) \
+  ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct {
+  const char *name;
+  uint32_t type;
+  uint64_t config;
+} events[] = {
+  {"cycles",       PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+  {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+  {"L1D-miss",     PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_L1D)},
+  {"LLC-miss",     PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_LL)},
+  {"branch-miss",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+#define NEVENTS ((int)(sizeof(events) / sizeof(events[0])))
+
+static const char *stage_names[PC_STAGES] = {"update", "color", "emit", "flush"};
+
+// Layout of a read with both time fields.
+typedef struct {
+  uint64_t value;
+  uint64_t time_enabled, time_running;
+} CountRead;
+
+struct PerfCounters {
+  int fd[NEVENTS];     // -1 for events this CPU / kernel doesn't offer
+  int nopen;
+  uint64_t last[NEVENTS];
+  uint64_t total[PC_STAGES][NEVENTS];
+  long frames;
+  int multiplexed;     // some counter didn't run all the time
+};
+
+// Counters are inherited by the threads started after them, so a frame
+// spread over a worker pool is counted whole. The kernel can't read an
+// inherited group in one go, so each event is on its own and read apart.
+static int open_event(int i, int exclude_kernel) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = events[i].type;
+  attr.config = events[i].config;
+  attr.inherit = 1;
+  attr.exclude_kernel = exclude_kernel;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static int read_counters(PerfCounters *pc, uint64_t now[NEVENTS]) {
+  for (int i = 0; i < NEVENTS; i++) {
+    CountRead r = {0, 0, 0};
+    if (pc->fd[i] >= 0 && read(pc->fd[i], &r, sizeof(r)) != (ssize_t)sizeof(r)) return -1;
+    if (r.time_running < r.time_enabled) pc->multiplexed = 1;
+    now[i] = r.value;
+  }
+  return 0;
+}
+
+PerfCounters *perfctr_open(void) {
+  PerfCounters *pc = (PerfCounters *)calloc(1, sizeof(*pc));
+  if (!pc) return NULL;
+
+  // Count kernel time too (the flush stage is mostly write()) unless
+  // perf_event_paranoid only allows user space.
+  int err = 0;
+  for (int exclude_kernel = 0; exclude_kernel <= 1 && !pc->nopen; exclude_kernel++) {
+    err = 0;
+    for (int i = 0; i < NEVENTS; i++) {
+      pc->fd[i] = open_event(i, exclude_kernel);
+      if (pc->fd[i] < 0) {
+        if (!err) err = errno;
+        continue;
+      }
+      pc->nopen++;
+    }
+  }
+  if (!pc->nopen) {
+    // ENOENT / EOPNOTSUPP: no PMU exposed (common in VMs and containers).
+    fprintf(stderr, "ematrix: perf counters unavailable: %s\n",
+            err == ENOENT || err == EOPNOTSUPP ? "no hardware counters on this machine"
+                                               : strerror(err));
+    free(pc);
+    return NULL;
+  }
+  for (int i = 0; i < NEVENTS; i++)
+    if (pc->fd[i] < 0) fprintf(stderr, "ematrix: perf counter %s unavailable\n", events[i].name);
+  return pc;
+}
+
+void perfctr_close(PerfCounters *pc) {
+  if (!pc) return;
+  for (int i = 0; i < NEVENTS; i++)
+    if (pc->fd[i] >= 0) close(pc->fd[i]);
+  free(pc);
+}
+
+void perfctr_begin(PerfCounters *pc) {
+  if (!pc) return;
+  if (read_counters(pc, pc->last) == 0) pc->frames++;
+}
+
+void perfctr_mark(PerfCounters *pc, int stage) {
+  if (!pc) return;
+  uint64_t now[NEVENTS];
+  if (read_counters(pc, now) < 0) return;
+  for (int i = 0; i < NEVENTS; i++) {
+    pc->total[stage][i] += now[i] - pc->last[i];
+    pc->last[i] = now[i];
+  }
+}
+
+static void report_table(const PerfCounters *pc, FILE *f, const char *title, double div) {
+  fprintf(f, "%-8s", title);
+  for (int i = 0; i < NEVENTS; i++)
+    if (pc->fd[i] >= 0) fprintf(f, " %14s", events[i].name);
+  fputc('\n', f);
+  for (int s = 0; s < PC_STAGES; s++) {
+    fprintf(f, "%-8s", stage_names[s]);
+    for (int i = 0; i < NEVENTS; i++)
+      if (pc->fd[i] >= 0) fprintf(f, " %14.0f", (double)pc->total[s][i] / div);
+    fputc('\n', f);
+  }
+}
+
+void perfctr_report(const PerfCounters *pc, FILE *f) {
+  if (!pc || !pc->frames) return;
+  fprintf(f, "perf counters over %ld frames%s\n", pc->frames,
+          pc->multiplexed ? " (multiplexed: counts are partial)" : "");
+  report_table(pc, f, "avg", (double)pc->frames);
+  report_table(pc, f, "total", 1.0);
+}
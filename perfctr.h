@@ -0,0 +1,33 @@
+// Hardware performance counters per frame stage, via perf_event_open.
+//
+// A frame is bracketed as
+//   perfctr_begin(pc);
+//   em_update(...);   perfctr_mark(pc, PC_UPDATE);
+//   em_compose(...);  perfctr_mark(pc, PC_COLOR);
+//   ...
+// and each mark charges everything counted since the previous mark to its
+// stage. Every call is a no-op on a NULL PerfCounters, so the frame loop
+// doesn't need to check whether counters are on.
+
+#ifndef EMATRIX_PERFCTR_H
+#define EMATRIX_PERFCTR_H
+
+#include <stdio.h>
+
+enum { PC_UPDATE, PC_COLOR, PC_EMIT, PC_FLUSH, PC_STAGES };
+
+typedef struct PerfCounters PerfCounters;
+
+// Open the counters for the calling thread and the threads it starts
+// afterwards, such as a worker pool. Returns NULL (with the reason on
+// stderr) when none of them can be opened.
+PerfCounters *perfctr_open(void);
+void perfctr_close(PerfCounters *pc);
+
+void perfctr_begin(PerfCounters *pc);
+void perfctr_mark(PerfCounters *pc, int stage);
+
+// Per-frame averages and totals for every stage.
+void perfctr_report(const PerfCounters *pc, FILE *f);
+
+#endif
@@ -0,0 +1,257 @@
+// Frame ring over POSIX shared memory (see publish.h).
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "publish.h"
+
+#define SLOT_ALIGN 64   // slots start on their own cache line
+#define TRIES      64   // lapped or torn reads before publish_begin gives up
+
+_Static_assert(sizeof(PublishHead) <= PUBLISH_HEAD_SIZE, "ring header outgrew its page");
+
+struct Publisher {
+  char path[256];
+  PublishHead *head;
+  uint64_t frame;             // the last frame published
+};
+
+struct PublishReader {
+  char path[256];
+  const PublishHead *head;    // mapped read-only
+  uint64_t last;              // the last frame read
+  uint64_t pending;           // the frame publish_begin() handed out
+};
+
+static int shm_path(const char *name, char *path, size_t len) {
+  if (!*name || strchr(name, '/') ||
+      (size_t)snprintf(path, len, "/ematrix-frames-%s", name) >= len) {
+    fprintf(stderr, "ematrix: bad frame ring name '%s'\n", name);
+    return -1;
+  }
+  return 0;
+}
+
+static int alive(int pid) {
+  return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+static PublishSlot *slot_at(const PublishHead *h, uint64_t frame) {
+  return (PublishSlot *)((char *)h + PUBLISH_HEAD_SIZE + (frame % h->nslots) * h->slot_size);
+}
+
+// A mapping of the whole segment behind fd, checked to be a frame ring;
+// writable only for the writer's side.
+static PublishHead *map_ring(int fd, int prot) {
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < PUBLISH_HEAD_SIZE) return NULL;
+  void *m = mmap(NULL, (size_t)st.st_size, prot, MAP_SHARED, fd, 0);
+  if (m == MAP_FAILED) return NULL;
+  PublishHead *h = (PublishHead *)m;
+  int ok = h->magic == PUBLISH_MAGIC;
+  atomic_thread_fence(memory_order_acquire);
+  if (!ok || h->size != (uint64_t)st.st_size || h->cell_size != sizeof(em_cell)) {
+    munmap(m, (size_t)st.st_size);
+    return NULL;
+  }
+  return h;
+}
+
+// Readers need only read access, so they work as any user the segment's
+// mode lets in and can't disturb the writer.
+static const PublishHead *open_ring(const char *path) {
+  int fd = shm_open(path, O_RDONLY, 0);
+  if (fd < 0) return NULL;
+  const PublishHead *h = map_ring(fd, PROT_READ);
+  close(fd);
+  return h;
+}
+
+// ---------------------------------------------------------------------------
+// Writer
+
+// An existing segment whose writer has gone can be replaced.
+static int stale(const char *path) {
+  int fd = shm_open(path, O_RDWR, 0);
+  if (fd < 0) return errno == ENOENT;
+  PublishHead *h = map_ring(fd, PROT_READ | PROT_WRITE);
+  close(fd);
+  if (!h) return 0;
+  int gone = !alive(atomic_load_explicit(&h->writer, memory_order_relaxed));
+  munmap(h, h->size);
+  return gone;
+}
+
+// A fresh segment at path with room for cells per slot, or NULL.
+static PublishHead *create_ring(const char *path, size_t cells) {
+  size_t slot = (sizeof(PublishSlot) + cells * sizeof(em_cell) + SLOT_ALIGN - 1) &
+                ~(size_t)(SLOT_ALIGN - 1);
+  size_t size = PUBLISH_HEAD_SIZE + PUBLISH_SLOTS * slot;
+  int fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0 && errno == EEXIST && stale(path)) {
+    shm_unlink(path);
+    fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+  }
+  if (fd < 0) return NULL;
+  void *m = ftruncate(fd, (off_t)size) == 0
+              ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+              : MAP_FAILED;
+  close(fd);
+  if (m == MAP_FAILED) {
+    shm_unlink(path);
+    return NULL;
+  }
+  // ftruncate zeroed the segment; the magic goes in last.
+  PublishHead *h = (PublishHead *)m;
+  h->size = size;
+  h->cell_size = sizeof(em_cell);
+  h->nslots = PUBLISH_SLOTS;
+  h->slot_cells = (uint32_t)cells;
+  h->slot_size = slot;
+  atomic_store(&h->writer, (int)getpid());
+  atomic_thread_fence(memory_order_release);
+  h->magic = PUBLISH_MAGIC;
+  return h;
+}
+
+Publisher *publish_open(const char *name, int rows, int cols) {
+  Publisher *p = (Publisher *)calloc(1, sizeof(*p));
+  if (!p) return NULL;
+  if (shm_path(name, p->path, sizeof(p->path)) < 0) {
+    free(p);
+    return NULL;
+  }
+  p->head = create_ring(p->path, (size_t)rows * (size_t)cols);
+  if (!p->head) {
+    fprintf(stderr, "ematrix: can't create frame ring %s: %s\n", p->path,
+            errno == EEXIST ? "another ematrix is publishing it" : strerror(errno));
+    free(p);
+    return NULL;
+  }
+  return p;
+}
+
+// Move to a segment with bigger slots. Readers holding the old one see
+// moved and open the name again; the frame numbers carry on.
+static int publish_grow(Publisher *p, size_t cells) {
+  PublishHead *old = p->head;
+  atomic_store_explicit(&old->moved, 1, memory_order_release);
+  shm_unlink(p->path);
+  p->head = create_ring(p->path, cells);
+  munmap(old, old->size);
+  return p->head ? 0 : -1;
+}
+
+int publish_frame(Publisher *p, const em_cell *cells, int rows, int cols, double t) {
+  size_t n = (size_t)rows * (size_t)cols;
+  if (!p->head || (n > p->head->slot_cells && publish_grow(p, n) < 0)) return -1;
+  PublishHead *h = p->head;
+  uint64_t f = ++p->frame;
+  PublishSlot *s = slot_at(h, f);
+  uint32_t seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+  atomic_store_explicit(&s->seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  s->rows = (uint32_t)rows;
+  s->cols = (uint32_t)cols;
+  s->frame = f;
+  s->time_ns = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+  s->t = t;
+  memcpy(s->cells, cells, n * sizeof(em_cell));
+  atomic_store_explicit(&s->seq, seq + 2, memory_order_release);
+  atomic_store_explicit(&h->head, f, memory_order_release);
+  return 0;
+}
+
+void publish_close(Publisher *p) {
+  if (!p) return;
+  if (p->head) {
+    atomic_store(&p->head->writer, 0);
+    munmap(p->head, p->head->size);
+    shm_unlink(p->path);
+  }
+  free(p);
+}
+
+// ---------------------------------------------------------------------------
+// Readers
+
+PublishReader *publish_attach(const char *name) {
+  PublishReader *r = (PublishReader *)calloc(1, sizeof(*r));
+  if (!r) return NULL;
+  if (shm_path(name, r->path, sizeof(r->path)) < 0 || !(r->head = open_ring(r->path))) {
+    free(r);
+    return NULL;
+  }
+  return r;
+}
+
+// Follow the writer to its new segment; until it exists, stay put.
+static void reader_follow(PublishReader *r) {
+  if (!atomic_load_explicit(&r->head->moved, memory_order_acquire)) return;
+  const PublishHead *h = open_ring(r->path);
+  if (!h) return;
+  munmap((void *)r->head, r->head->size);
+  r->head = h;
+}
+
+const PublishSlot *publish_begin(PublishReader *r, uint32_t *seq) {
+  reader_follow(r);
+  const PublishHead *h = r->head;
+  for (int tries = 0; tries < TRIES; tries++) {
+    uint64_t f = atomic_load_explicit(&h->head, memory_order_acquire);
+    if (f <= r->last) return NULL;
+    const PublishSlot *s = slot_at(h, f);
+    uint32_t q = atomic_load_explicit(&s->seq, memory_order_acquire);
+    if (q & 1) continue;  // the writer has lapped us into this slot
+    uint64_t n = (uint64_t)s->rows * s->cols;
+    r->pending = s->frame;
+    if (n > h->slot_cells || r->pending <= r->last) continue;
+    *seq = q;
+    return s;
+  }
+  return NULL;
+}
+
+static int slot_intact(const PublishSlot *s, uint32_t seq) {
+  atomic_thread_fence(memory_order_acquire);
+  return atomic_load_explicit(&s->seq, memory_order_relaxed) == seq;
+}
+
+int publish_end(PublishReader *r, const PublishSlot *s, uint32_t seq) {
+  if (!slot_intact(s, seq)) return 0;
+  r->last = r->pending;
+  return 1;
+}
+
+int publish_read(PublishReader *r, em_cell *cells, size_t cap, PublishFrame *info) {
+  for (;;) {
+    uint32_t seq;
+    const PublishSlot *s = publish_begin(r, &seq);
+    if (!s) return alive(atomic_load_explicit(&r->head->writer, memory_order_relaxed)) ? 0 : -1;
+    PublishFrame f = {(int)s->rows, (int)s->cols, s->frame, s->time_ns, s->t};
+    size_t n = (size_t)f.rows * (size_t)f.cols;
+    if (n > r->head->slot_cells) continue;  // torn: rows and cols from different frames
+    if (n <= cap) memcpy(cells, s->cells, n * sizeof(em_cell));
+    if (!slot_intact(s, seq)) continue;
+    *info = f;
+    if (n > cap) return 0;
+    r->last = r->pending;
+    return 1;
+  }
+}
+
+void publish_detach(PublishReader *r) {
+  if (!r) return;
+  munmap((void *)r->head, r->head->size);
+  free(r);
+}
@@ -0,0 +1,94 @@
+// Frame ring (--publish): every composed cell frame, published through
+// POSIX shared memory for other processes on this machine (recorders,
+// streamers, status bars, tests) to read without parsing escapes.
+//
+// /dev/shm/ematrix-frames-NAME is a header page followed by nslots slots,
+// slot_size bytes apart. Frame n (counting from 1) goes into slot
+// n % nslots, and head is the newest complete frame. Each slot is a
+// seqlock: the writer makes seq odd, fills the slot in and makes seq even
+// again, so a reader that sees the same even seq before and after copying
+// got a whole frame. A reader can use the helpers below or read the
+// layout directly; everything is in the host's byte order.
+//
+// A slot holds at most slot_cells cells. When the terminal outgrows them
+// the writer moves to a fresh segment of the same name and sets moved in
+// the old one; readers then open the name again (the helpers do).
+
+#ifndef EMATRIX_PUBLISH_H
+#define EMATRIX_PUBLISH_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ematrix.h"
+
+#define PUBLISH_MAGIC     0x316d617266656d65ULL  // "emframe1"
+#define PUBLISH_HEAD_SIZE 4096                   // the slots start on the next page
+#define PUBLISH_SLOTS     4
+
+typedef struct {
+  uint64_t magic;              // PUBLISH_MAGIC, set once the rest is valid
+  uint64_t size;               // the whole segment
+  uint32_t cell_size;          // sizeof(em_cell)
+  uint32_t nslots;
+  uint32_t slot_cells;         // cells a slot has room for
+  uint32_t pad;
+  uint64_t slot_size;          // bytes from one slot to the next
+  _Atomic int writer;          // the writer's pid, 0 once it has gone
+  _Atomic uint32_t moved;      // this segment is retired: open the name again
+  _Atomic uint64_t head;       // the newest complete frame, 0 before the first
+} PublishHead;
+
+typedef struct {
+  _Atomic uint32_t seq;        // odd while the writer is in the slot
+  uint32_t rows, cols;
+  uint32_t pad;
+  uint64_t frame;              // the frame number, from 1
+  int64_t  time_ns;            // CLOCK_REALTIME when it was published
+  double   t;                  // the frame's simulation clock, in seconds
+  em_cell  cells[];            // rows * cols, row by row
+} PublishSlot;
+
+// Writing
+
+typedef struct Publisher Publisher;
+
+// Create NAME's ring with room for rows x cols frames (it grows when
+// needed). NULL, with a message on stderr, if another live writer has it.
+Publisher *publish_open(const char *name, int rows, int cols);
+// Publish a rows x cols frame taken at clock t. Never blocks; allocates
+// only to grow. -1 if the ring could not grow to the new size.
+int  publish_frame(Publisher *p, const em_cell *cells, int rows, int cols, double t);
+// Mark the writer gone and remove the name.
+void publish_close(Publisher *p);
+
+// Reading
+
+typedef struct PublishReader PublishReader;
+
+// Map NAME's ring. NULL when there is none.
+PublishReader *publish_attach(const char *name);
+// Zero-copy: the slot of the newest frame not yet read and its seq, or
+// NULL when there is no newer frame. Use the slot's fields and cells
+// (rows * cols never exceeds slot_cells, but read rows and cols once),
+// then check that the writer left them alone with publish_end(); if it
+// returns 0, throw what was read away and begin again.
+const PublishSlot *publish_begin(PublishReader *r, uint32_t *seq);
+int  publish_end(PublishReader *r, const PublishSlot *s, uint32_t seq);
+
+// What publish_read() copied besides the cells.
+typedef struct {
+  int rows, cols;
+  uint64_t frame;
+  int64_t time_ns;
+  double t;
+} PublishFrame;
+
+// Copy the newest frame not yet read into cells, which has room for cap.
+// 1: a new frame; 0: nothing new, or it didn't fit (info says how big it
+// is); -1: the writer has gone and its last frame has been read.
+int  publish_read(PublishReader *r, em_cell *cells, size_t cap, PublishFrame *info);
+void publish_detach(PublishReader *r);
+
+#endif
@@ -0,0 +1,644 @@
+// Presenter and output backends: ncurses, raw ANSI, null and recorder.
+
+#include <ncurses.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "render.h"
+
+// Frames a change may be deferred before it is promoted to EM_PRIO_RING,
+// so low-priority clears can't be starved forever by a busy ring.
+#define DEFER_PROMOTE 24
+
+#define SYNC_BEGIN "\033[?2026h"
+#define SYNC_END   "\033[?2026l"
+
+void palette_init(Palette *pal, int ncolors) {
+  for (int i = 0; i < PAL_PAIRS; i++) pal->fg[i] = pal->bg[i] = -1;
+  pal->fg[1] = pal->fg[2] = pal->fg[3] = COLOR_GREEN;
+  // "Black hole" rainbow palette (fg on black bg)
+  // If the terminal supports 256 colors, use bright extended palette indices.
+  if (ncolors >= 256) {
+    // blue, cyan, green, yellow, orange, red, magenta, purple, white
+    static const short pal256[] = {21, 51, 46, 226, 202, 196, 201, 93, 231};
+    pal->bh_base = 20;
+    pal->bh_count = 9;
+    for (int i = 0; i < 9; i++) pal->fg[20 + i] = pal256[i], pal->bg[20 + i] = COLOR_BLACK;
+  } else {
+    // fallback: basic colors (still rainbow-ish)
+    static const short pal8[] = {COLOR_BLUE, COLOR_CYAN, COLOR_GREEN, COLOR_YELLOW,
+                                 COLOR_RED, COLOR_MAGENTA, COLOR_WHITE};
+    pal->bh_base = 10;
+    pal->bh_count = 7;
+    for (int i = 0; i < 7; i++) pal->fg[10 + i] = pal8[i], pal->bg[10 + i] = COLOR_BLACK;
+  }
+}
+
+static int cell_same(const em_cell *a, const em_cell *b) {
+  return a->ch == b->ch && a->pair == b->pair && a->attr == b->attr &&
+         a->tc == b->tc;
+}
+
+static int digits(int v) {
+  int n = 1;
+  while (v >= 10) v /= 10, n++;
+  return n;
+}
+
+// Rough escape-sequence cost of drawing cell c at (y, x), given where the
+// cursor is and which rendition was last emitted. Mirrors what a terminfo
+// driver sends: CUP when not adjacent, an SGR when the rendition changes,
+// then the glyph itself.
+static int cell_cost(const em_cell *c, int y, int x, int cury, int curx, const em_cell *last) {
+  int n = 1;
+  if (y != cury || x != curx) n += 4 + digits(y + 1) + digits(x + 1); // ESC[y;xH
+  if (c->pair != last->pair || c->attr != last->attr || c->tc != last->tc) {
+    n += 4;                                   // ESC[0 ... m
+    if (c->tc)        n += 17;                // ESC[38;2;RRR;GGG;BBBm
+    else if (c->pair) n += 9;                 // ;38;5;NNN
+    if (c->attr & EM_BOLD)  n += 2;
+    if (c->attr & EM_DIM)   n += 2;
+    if (c->attr & EM_BLINK) n += 2;
+  }
+  return n;
+}
+
+// ---------------------------------------------------------------------------
+// Output arena
+
+// Frame output arena: everything a frame writes is appended here and
+// handed to the kernel in one write(). It only grows (doubling) when a
+// frame is bigger than any before it, so the steady state never allocates.
+typedef struct {
+  char  *buf;
+  size_t len, cap;
+} OutBuf;
+
+static void out_reserve(OutBuf *b, size_t n) {
+  if (b->len + n <= b->cap) return;
+  size_t cap = b->cap ? b->cap : 1 << 16;
+  while (cap < b->len + n) cap *= 2;
+  char *nb = (char *)realloc(b->buf, cap);
+  if (!nb) endwin(), exit(1);
+  b->buf = nb;
+  b->cap = cap;
+}
+
+// The out_* appenders assume the caller reserved enough room.
+static void out_bytes(OutBuf *b, const void *s, size_t n) {
+  memcpy(b->buf + b->len, s, n);
+  b->len += n;
+}
+
+static void out_str(OutBuf *b, const char *s) {
+  out_bytes(b, s, strlen(s));
+}
+
+static void out_int(OutBuf *b, int v) {
+  char tmp[12];
+  int n = 0;
+  do tmp[n++] = (char)('0' + v % 10), v /= 10; while (v);
+  while (n) b->buf[b->len++] = tmp[--n];
+}
+
+// Write the whole arena to fd and empty it. Normally a single write();
+// loops only on short writes, EINTR, or a full non-blocking pipe.
+static void out_flush(OutBuf *b, int fd) {
+  size_t off = 0;
+  while (fd >= 0 && off < b->len) {
+    ssize_t w = write(fd, b->buf + off, b->len - off);
+    if (w > 0) {
+      off += (size_t)w;
+    } else if (w < 0 && errno == EAGAIN) {
+      struct pollfd p = {fd, POLLOUT, 0};
+      poll(&p, 1, -1);
+    } else if (w < 0 && errno != EINTR) {
+      break;
+    }
+  }
+  b->len = 0;
+}
+
+// ---------------------------------------------------------------------------
+// ncurses backend
+
+typedef struct {
+  Backend be;
+  int sync;
+} NcursesBackend;
+
+static void nc_resize(Backend *be, int rows, int cols) {
+  (void)be; (void)rows; (void)cols;
+  clear();
+}
+
+static void nc_begin_frame(Backend *be) {
+  (void)be;
+}
+
+static void nc_put_cell(Backend *be, const em_cell *c, int y, int x) {
+  (void)be;
+  attr_t a = A_NORMAL;
+  if (c->pair) a |= COLOR_PAIR(c->pair);
+  if (c->attr & EM_BOLD)  a |= A_BOLD;
+  if (c->attr & EM_DIM)   a |= A_DIM;
+  if (c->attr & EM_BLINK) a |= A_BLINK;
+  attrset(a);
+  mvaddch(y, x, c->ch ? (chtype)(unsigned char)c->ch : (chtype)' ');
+}
+
+static void nc_end_frame(Backend *be) {
+  NcursesBackend *nb = (NcursesBackend *)be;
+  attrset(A_NORMAL);
+  // ncurses already collects a whole doupdate() in its own buffer and
+  // flushes it once; the markers go out around that flush.
+  if (nb->sync) (void)!write(STDOUT_FILENO, SYNC_BEGIN, sizeof(SYNC_BEGIN) - 1);
+  refresh();
+  if (nb->sync) (void)!write(STDOUT_FILENO, SYNC_END, sizeof(SYNC_END) - 1);
+}
+
+static void nc_destroy(Backend *be) {
+  free(be);
+}
+
+Backend *backend_ncurses(const Palette *pal, int sync) {
+  NcursesBackend *nb = (NcursesBackend *)calloc(1, sizeof(*nb));
+  if (!nb) return NULL;
+  nb->be.name = "ncurses";
+  nb->be.resize = nc_resize;
+  nb->be.begin_frame = nc_begin_frame;
+  nb->be.put_cell = nc_put_cell;
+  nb->be.end_frame = nc_end_frame;
+  nb->be.destroy = nc_destroy;
+  nb->be.frame_bytes = -1;
+  nb->sync = sync;
+
+  if (has_colors()) {
+    start_color();
+    use_default_colors();
+    for (int i = 1; i < PAL_PAIRS; i++)
+      if (pal->fg[i] >= 0) init_pair((short)i, pal->fg[i], pal->bg[i]);
+  }
+  return &nb->be;
+}
+
+// ---------------------------------------------------------------------------
+// Raw ANSI backend
+
+// Colors are keyed as truecolor index (1..EM_TC_COUNT-1) or EM_TC_COUNT + pair,
+// each with a preformatted SGR so emitting a color is one memcpy.
+#define ANSI_COLORS (EM_TC_COUNT + PAL_PAIRS)
+
+// Typical bytes for a cell drawn with its own CUP and truecolor SGR.
+#define ANSI_CELL_BYTES 40
+
+// ncurses still owns the terminal modes and keyboard when this backend
+// draws to the tty; we just never touch stdscr, so its refreshes stay
+// empty and don't fight with what we write.
+// One encoded stream: the frame itself, or one band of it.
+typedef struct {
+  OutBuf out;
+  int cury, curx;          // where the terminal cursor is (-1: unknown)
+  int attr, color;         // rendition last emitted
+  int sgr_valid;
+} AnsiStream;
+
+typedef struct {
+  Backend be;
+  AnsiStream main;
+  AnsiStream *band;        // nbands, appended to main by end_frame; each
+                           // starts with the cursor and rendition unknown
+  int nbands;
+  int fd;
+  int held;                // fd < 0: main holds the last frame until the next starts
+  int sync;                // bracket frames with SYNC_BEGIN/SYNC_END
+  int truecolor;
+  int cols;
+  char seq[ANSI_COLORS][24];
+  unsigned char len[ANSI_COLORS];
+  unsigned char has_bg[ANSI_COLORS];
+} AnsiBackend;
+
+static void hsv_rgb(float h, float s, float v, int rgb[3]) {
+  float hh = fmodf(h, 360.0f) / 60.0f;
+  int   i  = (int)hh;
+  float f  = hh - (float)i;
+  float p = v * (1.0f - s), q = v * (1.0f - s * f), t = v * (1.0f - s * (1.0f - f));
+  float r, g, b;
+  switch (i) {
+    case 0:  r = v; g = t; b = p; break;
+    case 1:  r = q; g = v; b = p; break;
+    case 2:  r = p; g = v; b = t; break;
+    case 3:  r = p; g = q; b = v; break;
+    case 4:  r = t; g = p; b = v; break;
+    default: r = v; g = p; b = q; break;
+  }
+  rgb[0] = (int)lroundf(r * 255.0f);
+  rgb[1] = (int)lroundf(g * 255.0f);
+  rgb[2] = (int)lroundf(b * 255.0f);
+}
+
+static int ansi_color_of(const AnsiBackend *ab, const em_cell *c) {
+  if (ab->truecolor && c->tc) return c->tc;
+  return c->pair ? EM_TC_COUNT + c->pair : 0;
+}
+
+static void ansi_free_bands(AnsiBackend *ab) {
+  for (int b = 0; b < ab->nbands; b++) free(ab->band[b].out.buf);
+  free(ab->band);
+  ab->band = NULL;
+  ab->nbands = 0;
+}
+
+// A memory sink drops the frame it held once something new is written.
+static void ansi_release(AnsiBackend *ab) {
+  if (!ab->held) return;
+  ab->main.out.len = 0;
+  ab->held = 0;
+}
+
+static void ansi_resize(Backend *be, int rows, int cols) {
+  AnsiBackend *ab = (AnsiBackend *)be;
+  ansi_release(ab);
+  ab->cols = cols;
+  // Room for every cell changing with a fresh CUP and SGR, so frames
+  // never have to grow the arena after a resize. Band streams grow to
+  // their own steady size over the first frames.
+  out_reserve(&ab->main.out, (size_t)rows * (size_t)cols * ANSI_CELL_BYTES);
+  out_reserve(&ab->main.out, 16);
+  out_str(&ab->main.out, "\033[0m\033[2J");
+  ab->main.sgr_valid = 0;
+  ab->main.cury = -1;
+  int nb = (rows + SCREEN_BAND_ROWS - 1) / SCREEN_BAND_ROWS;
+  if (nb == ab->nbands) return;  // the band streams are empty between frames
+  ansi_free_bands(ab);
+  ab->band = (AnsiStream *)calloc((size_t)nb, sizeof(AnsiStream));
+  if (!ab->band) endwin(), exit(1);
+  ab->nbands = nb;
+  for (int b = 0; b < nb; b++) ab->band[b].cury = -1;
+}
+
+static void ansi_begin_frame(Backend *be) {
+  AnsiBackend *ab = (AnsiBackend *)be;
+  ansi_release(ab);
+  if (ab->sync) {
+    out_reserve(&ab->main.out, sizeof(SYNC_BEGIN));
+    out_str(&ab->main.out, SYNC_BEGIN);
+  }
+}
+
+static void ansi_encode(const AnsiBackend *ab, AnsiStream *st, const em_cell *c, int y, int x) {
+  OutBuf *o = &st->out;
+  int color = c->ch ? ansi_color_of(ab, c) : 0;
+  out_reserve(o, 64); // CUP + SGR + color + glyph, worst case
+  if (y != st->cury || x != st->curx) {
+    out_bytes(o, "\033[", 2);
+    out_int(o, y + 1);
+    o->buf[o->len++] = ';';
+    out_int(o, x + 1);
+    o->buf[o->len++] = 'H';
+  }
+  if (!c->ch && st->sgr_valid && !ab->has_bg[st->color]) {
+    // A blank only shows its background, so the current rendition will do.
+  } else if (!st->sgr_valid || c->attr != st->attr || color != st->color) {
+    if (!st->sgr_valid || c->attr != st->attr || !color) {
+      // Attribute change needs a reset, which also drops the color.
+      out_bytes(o, "\033[0", 3);
+      if (c->attr & EM_BOLD)  out_bytes(o, ";1", 2);
+      if (c->attr & EM_DIM)   out_bytes(o, ";2", 2);
+      if (c->attr & EM_BLINK) out_bytes(o, ";5", 2);
+      o->buf[o->len++] = 'm';
+      st->color = 0;
+    }
+    if (color && color != st->color) out_bytes(o, ab->seq[color], ab->len[color]);
+    st->attr = c->attr;
+    st->color = color;
+    st->sgr_valid = 1;
+  }
+  o->buf[o->len++] = c->ch ? c->ch : ' ';
+  st->cury = y;
+  st->curx = x + 1;
+  if (st->curx >= ab->cols) st->cury = -1; // pending wrap, position unknown
+}
+
+static void ansi_put_cell(Backend *be, const em_cell *c, int y, int x) {
+  AnsiBackend *ab = (AnsiBackend *)be;
+  ansi_encode(ab, &ab->main, c, y, x);
+}
+
+static void ansi_put_cell_band(Backend *be, int band, const em_cell *c, int y, int x) {
+  AnsiBackend *ab = (AnsiBackend *)be;
+  ansi_encode(ab, &ab->band[band], c, y, x);
+}
+
+static void ansi_end_frame(Backend *be) {
+  AnsiBackend *ab = (AnsiBackend *)be;
+  OutBuf *o = &ab->main.out;
+  // Each band opens with its own CUP and SGR, so they just concatenate.
+  for (int b = 0; b < ab->nbands; b++) {
+    AnsiStream *st = &ab->band[b];
+    if (!st->out.len) continue;
+    out_reserve(o, st->out.len);
+    out_bytes(o, st->out.buf, st->out.len);
+    st->out.len = 0;
+    st->sgr_valid = 0;
+    st->cury = -1;
+  }
+  out_reserve(o, 4 + sizeof(SYNC_END));
+  out_str(o, "\033[0m");
+  if (ab->sync) out_str(o, SYNC_END);
+  be->frame_bytes = (long)o->len;
+  if (ab->fd >= 0) out_flush(o, ab->fd);
+  else             ab->held = 1;
+  ab->main.sgr_valid = 0;
+  ab->main.cury = -1;
+}
+
+const char *backend_ansi_output(Backend *be, size_t *len) {
+  AnsiBackend *ab = (AnsiBackend *)be;
+  *len = ab->held ? ab->main.out.len : 0;
+  return ab->main.out.buf;
+}
+
+static void ansi_destroy(Backend *be) {
+  AnsiBackend *ab = (AnsiBackend *)be;
+  ansi_free_bands(ab);
+  free(ab->main.out.buf);
+  free(ab);
+}
+
+Backend *backend_ansi(const Palette *pal, int fd, int truecolor, int sync) {
+  AnsiBackend *ab = (AnsiBackend *)calloc(1, sizeof(*ab));
+  if (!ab) return NULL;
+  ab->be.name = "ansi";
+  ab->be.resize = ansi_resize;
+  ab->be.begin_frame = ansi_begin_frame;
+  ab->be.put_cell = ansi_put_cell;
+  ab->be.put_cell_band = ansi_put_cell_band;
+  ab->be.end_frame = ansi_end_frame;
+  ab->be.destroy = ansi_destroy;
+  ab->fd = fd;
+  ab->sync = sync;
+  ab->truecolor = truecolor;
+  ab->main.cury = ab->main.curx = -1;
+  out_reserve(&ab->main.out, 1 << 16);
+
+  for (int i = 1; i < EM_TC_COUNT; i++) {
+    int rgb[3];
+    if (i <= EM_TC_HUES * EM_TC_LEVELS) {
+      int h = (i - 1) / EM_TC_LEVELS, l = (i - 1) % EM_TC_LEVELS;
+      // Same walk as the 256-color rainbow: blue, cyan, green, yellow,
+      // red, magenta, purple and back to blue.
+      float deg = 240.0f - 360.0f * ((float)h + 0.5f) / (float)EM_TC_HUES;
+      if (deg < 0.0f) deg += 360.0f;
+      hsv_rgb(deg, 1.0f, 0.35f + 0.65f * (float)l / (float)(EM_TC_LEVELS - 1), rgb);
+    } else {
+      int l = i - 1 - EM_TC_HUES * EM_TC_LEVELS;
+      rgb[0] = rgb[1] = rgb[2] = 140 + (115 * l) / (EM_TC_WHITES - 1);
+    }
+    ab->len[i] = (unsigned char)snprintf(ab->seq[i], sizeof(ab->seq[i]),
+                                         "\033[38;2;%d;%d;%dm", rgb[0], rgb[1], rgb[2]);
+  }
+  for (int p = 1; p < PAL_PAIRS; p++) {
+    int k = EM_TC_COUNT + p, n;
+    if (pal->fg[p] < 0) continue;
+    if (pal->fg[p] < 8) n = snprintf(ab->seq[k], sizeof(ab->seq[k]), "\033[%d", 30 + pal->fg[p]);
+    else                n = snprintf(ab->seq[k], sizeof(ab->seq[k]), "\033[38;5;%d", pal->fg[p]);
+    ab->has_bg[k] = pal->bg[p] >= 0;
+    if (pal->bg[p] >= 0) n += snprintf(ab->seq[k] + n, sizeof(ab->seq[k]) - (size_t)n, ";%d", 40 + pal->bg[p]);
+    n += snprintf(ab->seq[k] + n, sizeof(ab->seq[k]) - (size_t)n, "m");
+    ab->len[k] = (unsigned char)n;
+  }
+  return &ab->be;
+}
+
+// ---------------------------------------------------------------------------
+// Null backend
+
+static void null_resize(Backend *be, int rows, int cols) { (void)be; (void)rows; (void)cols; }
+static void null_frame(Backend *be) { (void)be; }
+static void null_put_cell(Backend *be, const em_cell *c, int y, int x) { (void)be; (void)c; (void)y; (void)x; }
+static void null_destroy(Backend *be) { free(be); }
+
+Backend *backend_null(void) {
+  Backend *be = (Backend *)calloc(1, sizeof(*be));
+  if (!be) return NULL;
+  be->name = "null";
+  be->resize = null_resize;
+  be->begin_frame = null_frame;
+  be->put_cell = null_put_cell;
+  be->end_frame = null_frame;
+  be->destroy = null_destroy;
+  return be;
+}
+
+// ---------------------------------------------------------------------------
+// Recorder backend
+//
+// File layout, all integers little-endian:
+//   "EMREC1\n\0"                             8-byte magic
+//   'S' u16 rows u16 cols                    screen (re)size, screen blank
+//   'F' u32 frame u32 count, count x {       one frame of changes
+//         u16 y u16 x u8 ch u8 pair u8 attr u8 tc }
+
+typedef struct {
+  Backend be;
+  OutBuf out;
+  int fd;
+  uint32_t frame;
+  size_t count_at;   // offset of the current frame's count field
+  uint32_t count;
+} RecorderBackend;
+
+static void put_u16(OutBuf *o, unsigned v) {
+  unsigned char b[2] = {(unsigned char)v, (unsigned char)(v >> 8)};
+  out_bytes(o, b, 2);
+}
+
+static void put_u32(OutBuf *o, uint32_t v) {
+  unsigned char b[4] = {(unsigned char)v, (unsigned char)(v >> 8),
+                        (unsigned char)(v >> 16), (unsigned char)(v >> 24)};
+  out_bytes(o, b, 4);
+}
+
+static void rec_resize(Backend *be, int rows, int cols) {
+  RecorderBackend *rb = (RecorderBackend *)be;
+  out_reserve(&rb->out, 16 + (size_t)rows * (size_t)cols * 8); // a full frame
+  out_reserve(&rb->out, 5);
+  rb->out.buf[rb->out.len++] = 'S';
+  put_u16(&rb->out, (unsigned)rows);
+  put_u16(&rb->out, (unsigned)cols);
+}
+
+static void rec_begin_frame(Backend *be) {
+  RecorderBackend *rb = (RecorderBackend *)be;
+  out_reserve(&rb->out, 9);
+  rb->out.buf[rb->out.len++] = 'F';
+  put_u32(&rb->out, rb->frame++);
+  rb->count_at = rb->out.len;
+  rb->count = 0;
+  put_u32(&rb->out, 0);
+}
+
+static void rec_put_cell(Backend *be, const em_cell *c, int y, int x) {
+  RecorderBackend *rb = (RecorderBackend *)be;
+  out_reserve(&rb->out, 8);
+  put_u16(&rb->out, (unsigned)y);
+  put_u16(&rb->out, (unsigned)x);
+  unsigned char b[4] = {(unsigned char)c->ch, c->pair, c->attr, c->tc};
+  out_bytes(&rb->out, b, 4);
+  rb->count++;
+}
+
+static void rec_end_frame(Backend *be) {
+  RecorderBackend *rb = (RecorderBackend *)be;
+  size_t len = rb->out.len;
+  rb->out.len = rb->count_at;
+  put_u32(&rb->out, rb->count);
+  rb->out.len = len;
+  be->frame_bytes = (long)len;
+  out_flush(&rb->out, rb->fd);
+}
+
+static void rec_destroy(Backend *be) {
+  RecorderBackend *rb = (RecorderBackend *)be;
+  close(rb->fd);
+  free(rb->out.buf);
+  free(rb);
+}
+
+Backend *backend_recorder(const char *path) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) return NULL;
+  RecorderBackend *rb = (RecorderBackend *)calloc(1, sizeof(*rb));
+  if (!rb) return close(fd), NULL;
+  rb->be.name = "recorder";
+  rb->be.resize = rec_resize;
+  rb->be.begin_frame = rec_begin_frame;
+  rb->be.put_cell = rec_put_cell;
+  rb->be.end_frame = rec_end_frame;
+  rb->be.destroy = rec_destroy;
+  rb->fd = fd;
+  out_reserve(&rb->out, 1 << 16);
+  out_bytes(&rb->out, "EMREC1\n", 8);
+  return &rb->be;
+}
+
+// ---------------------------------------------------------------------------
+// Presenter
+
+int screen_resize(Screen *s, int rows, int cols) {
+  int n = rows * cols;
+  if (n > s->cap) {
+    free(s->shown); free(s->defer); free(s->queue);
+    s->shown = (em_cell *)malloc((size_t)n * sizeof(em_cell));
+    s->defer = (unsigned char *)malloc((size_t)n);
+    s->queue = (int *)malloc((size_t)n * sizeof(int));
+    s->cap = n;
+    if (!s->shown || !s->defer || !s->queue) return -1;
+  }
+  s->rows = rows;
+  s->cols = cols;
+  memset(s->shown, 0, (size_t)n * sizeof(em_cell));
+  memset(s->defer, 0, (size_t)n);
+  return 0;
+}
+
+void screen_free(Screen *s) {
+  free(s->shown); free(s->defer); free(s->queue);
+  memset(s, 0, sizeof(*s));
+}
+
+typedef struct {
+  Screen *s;
+  Backend *be;
+  const em_cell *frame;
+} BandArg;
+
+// Unbudgeted present of one band, on a worker.
+static void present_band(void *arg, int b) {
+  BandArg *a = (BandArg *)arg;
+  int cols = a->s->cols;
+  int y1 = (b + 1) * SCREEN_BAND_ROWS < a->s->rows ? (b + 1) * SCREEN_BAND_ROWS : a->s->rows;
+  em_cell *shown = a->s->shown;
+  for (int i = b * SCREEN_BAND_ROWS * cols; i < y1 * cols; i++) {
+    if (cell_same(&a->frame[i], &shown[i])) continue;
+    a->be->put_cell_band(a->be, b, &a->frame[i], i / cols, i % cols);
+    shown[i] = a->frame[i];
+  }
+}
+
+long screen_present(Screen *s, Backend *be, const em_cell *frame, long budget) {
+  int n = s->rows * s->cols, cols = s->cols;
+  em_cell *shown = s->shown;
+  unsigned char *defer = s->defer;
+  int *queue = s->queue;
+
+  if (budget < 0 && be->put_cell_band && workers_count(s->workers) > 1) {
+    BandArg a = {s, be, frame};
+    workers_run(s->workers, "present band", (s->rows + SCREEN_BAND_ROWS - 1) / SCREEN_BAND_ROWS,
+                present_band, &a);
+    return 0;
+  }
+  if (budget < 0) {
+    for (int i = 0; i < n; i++) {
+      if (cell_same(&frame[i], &shown[i])) continue;
+      be->put_cell(be, &frame[i], i / cols, i % cols);
+      shown[i] = frame[i];
+    }
+    return 0;
+  }
+
+  // Changes ordered by priority class, scan order within a class so runs
+  // stay adjacent, then drawn until the estimated cost exceeds the budget.
+  int count[EM_PRIO_COUNT] = {0};
+  int start[EM_PRIO_COUNT];
+  for (int pass = 0; pass < 2; pass++) {
+    if (pass == 1) {
+      int o = 0;
+      for (int k = 0; k < EM_PRIO_COUNT; k++) start[k] = o, o += count[k];
+    }
+    for (int i = 0; i < n; i++) {
+      if (cell_same(&frame[i], &shown[i])) { defer[i] = 0; continue; }
+      int k;
+      if (defer[i] >= DEFER_PROMOTE)  k = EM_PRIO_RING;
+      else if (!frame[i].ch)          k = EM_PRIO_CLEAR;
+      else if (!shown[i].ch)          k = frame[i].prio < EM_PRIO_LIT ? frame[i].prio : EM_PRIO_LIT;
+      else                            k = frame[i].prio;
+      if (pass == 0) count[k]++;
+      else queue[start[k]++] = i;
+    }
+  }
+
+  int total = 0;
+  for (int k = 0; k < EM_PRIO_COUNT; k++) total += count[k];
+
+  long spent = 0;
+  int cury = -1, curx = -1;
+  em_cell last = {0, 0, 0, 0, 0};
+  int j = 0;
+  for (; j < total; j++) {
+    int i = queue[j];
+    int y = i / cols, x = i % cols;
+    int cost = cell_cost(&frame[i], y, x, cury, curx, &last);
+    if (spent + cost > budget) break;
+    spent += cost;
+    be->put_cell(be, &frame[i], y, x);
+    shown[i] = frame[i];
+    defer[i] = 0;
+    last = frame[i];
+    cury = y; curx = x + 1;
+  }
+  for (; j < total; j++) {
+    int i = queue[j];
+    if (defer[i] < 255) defer[i]++;
+  }
+  return spent;
+}
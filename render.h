@@ -0,0 +1,79 @@
+// Presentation side of ematrix: the composed cell frame, the diffing /
+// bandwidth-limited presenter, and the output backends it drives.
+
+#ifndef EMATRIX_RENDER_H
+#define EMATRIX_RENDER_H
+
+#include "ematrix.h"
+#include "workers.h"
+
+// Color pairs shared by every backend. ncurses gets them via init_pair,
+// the ANSI backend turns them into SGR sequences.
+#define PAL_PAIRS 32
+
+typedef struct {
+  short fg[PAL_PAIRS], bg[PAL_PAIRS]; // -1 = terminal default
+  int   bh_base, bh_count;            // black-hole rainbow pairs
+} Palette;
+
+// Fill in the pair table for a terminal with ncolors colors (0 = none).
+void palette_init(Palette *pal, int ncolors);
+
+// Output backend. The presenter calls begin_frame, put_cell for every cell
+// that changed, then end_frame. resize clears the output and must be
+// called before the first frame.
+//
+// A backend that can encode parts of a frame concurrently also sets
+// put_cell_band. The screen is cut into bands of SCREEN_BAND_ROWS rows,
+// and a presenter with workers then calls put_cell_band instead of
+// put_cell, for several bands at once from different threads (each band
+// from one). end_frame emits the bands in order.
+#define SCREEN_BAND_ROWS 8
+
+typedef struct Backend Backend;
+struct Backend {
+  const char *name;
+  void (*resize)(Backend *be, int rows, int cols);
+  void (*begin_frame)(Backend *be);
+  void (*put_cell)(Backend *be, const em_cell *c, int y, int x);
+  void (*put_cell_band)(Backend *be, int band, const em_cell *c, int y, int x);  // or NULL
+  void (*end_frame)(Backend *be);
+  void (*destroy)(Backend *be);
+  long frame_bytes;   // bytes produced by the last frame, -1 if unknown
+};
+
+// Draw through ncurses' stdscr. initscr() must already have been called.
+Backend *backend_ncurses(const Palette *pal, int sync);
+// Write ANSI escapes straight to fd, one write() per frame. fd < 0 makes
+// it a memory sink that keeps each frame until the next one starts.
+Backend *backend_ansi(const Palette *pal, int fd, int truecolor, int sync);
+// A memory-sink ANSI backend's last frame, along with anything a resize
+// queued before it (0 bytes between begin_frame and end_frame).
+const char *backend_ansi_output(Backend *be, size_t *len);
+// Accept and drop everything; for timing the simulation alone.
+Backend *backend_null(void);
+// Append every frame's cell changes to a file (format in render.c).
+Backend *backend_recorder(const char *path);
+
+// What is currently on the output, plus the bandwidth limiter's scratch.
+typedef struct {
+  em_cell       *shown;
+  unsigned char *defer;   // frames each pending change has been deferred
+  int           *queue;   // changed cells ordered by priority
+  int rows, cols, cap;
+  Workers       *workers; // optional, the caller's: diff and encode bands in
+                          // parallel (unbudgeted frames, put_cell_band only)
+} Screen;
+
+// Resize to rows x cols and forget what was shown (output is blank).
+// Returns -1 on allocation failure.
+int  screen_resize(Screen *s, int rows, int cols);
+void screen_free(Screen *s);  // leaves s->workers to its owner
+
+// Send the cells of frame that differ from what is shown to be. With
+// budget < 0 every change goes out; otherwise changes are spent against
+// the estimated byte budget in priority order and the rest deferred.
+// Returns the estimated bytes spent (0 when unlimited).
+long screen_present(Screen *s, Backend *be, const em_cell *frame, long budget);
+
+#endif
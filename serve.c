@@ -0,0 +1,614 @@
+// Frame broadcast server (see serve.h).
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "serve.h"
+
+// Sizes a viewer can ask for; anything bigger is clamped, so nobody can
+// make the server simulate an absurd screen.
+#define MIN_ROWS      4
+#define MIN_COLS      8
+#define MAX_ROWS      300
+#define MAX_COLS      1000
+#define DEFAULT_ROWS  24
+#define DEFAULT_COLS  80
+
+#define LISTEN_RETRY_S 1.0  // how long accept() rests after running out of fds
+#define LINGER_S       1.0  // how long a leaving viewer gets to take its last bytes
+
+#define IAC  255
+#define SB   250
+#define SE   240
+#define IP   244
+#define NAWS 31
+
+// Sent on connect. Over telnet: we echo (i.e. the client doesn't), we
+// suppress go-ahead (character mode), and please report the window size.
+static const char TELNET_HELLO[] = "\377\373\001\377\373\003\377\375\037";
+// On a raw terminal: report the text area size (CSI 8 ; rows ; cols t).
+static const char SIZE_QUERY[] = "\033[18t";
+static const char HIDE_CURSOR[] = "\033[?25l";
+static const char GOODBYE[] = "\033[0m\033[2J\033[H\033[?25h";
+
+typedef struct Group Group;
+
+// The viewers of one terminal size, and what they have been sent.
+struct Group {
+  int rows, cols;
+  int *ys, *xs;             // canonical rows/columns each cell covers: [ys[y], ys[y + 1])
+  em_cell *cells;           // this frame at the group's size
+  Screen screen;            // what every up-to-date viewer shows
+  Backend *be;              // memory sink: each frame's diff
+  Screen blank;             // keyframes are drawn against a blank screen
+  Backend *key_be;
+  const char *key;          // this frame's keyframe, once someone needs it
+  size_t key_len;
+  int nclients;
+  Group *next;
+};
+
+// Viewer input: telnet commands (TCP only), CSI replies, keys.
+enum { IN_DATA, IN_IAC, IN_OPT, IN_SB, IN_SB_IAC, IN_ESC, IN_CSI };
+
+// Why a viewer is going: it asked to (and gets its terminal back), or
+// the connection broke.
+enum { DROP_QUIT = 1, DROP_BROKEN };
+
+typedef struct {
+  int fd;
+  int tcp;
+  Group *g;
+  int state;
+  unsigned char arg[32];    // a subnegotiation or CSI being read
+  int narg;
+  char *pend;               // the unsent rest of a frame
+  size_t pend_off, pend_len, pend_cap;
+  int need_key;             // missed a frame: send a keyframe, not a diff
+  int drop;                 // DROP_*, or 0
+  double leaving;           // DROP_QUIT: when it started draining its last bytes
+} Client;
+
+typedef struct {
+  em_ctx *sim;              // the canonical frame every group is resampled from
+  int rows, cols;
+  const Palette *pal;
+  int truecolor;
+  int ep;
+  int lfd;
+  double listen_paused;     // when accept() ran out of fds, else 0
+  Group *groups;
+  Client **client;
+  int nclients, cap;
+} Server;
+
+static char LISTEN_TAG, TIMER_TAG, SIGNAL_TAG;
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// ---------------------------------------------------------------------------
+// Size groups
+
+static void group_destroy(Group *g) {
+  free(g->ys);
+  free(g->cells);
+  screen_free(&g->screen);
+  screen_free(&g->blank);
+  if (g->be) g->be->destroy(g->be);
+  if (g->key_be) g->key_be->destroy(g->key_be);
+  free(g);
+}
+
+// The group for rows x cols, created on first use. NULL on allocation failure.
+static Group *group_get(Server *sv, int rows, int cols) {
+  for (Group *g = sv->groups; g; g = g->next)
+    if (g->rows == rows && g->cols == cols) return g;
+  Group *g = (Group *)calloc(1, sizeof(*g));
+  if (!g) return NULL;
+  g->rows = rows;
+  g->cols = cols;
+  g->ys = (int *)malloc((size_t)(rows + cols + 2) * sizeof(int));
+  g->cells = (em_cell *)malloc((size_t)rows * (size_t)cols * sizeof(em_cell));
+  g->be = backend_ansi(sv->pal, -1, sv->truecolor, 0);
+  g->key_be = backend_ansi(sv->pal, -1, sv->truecolor, 0);
+  if (!g->ys || !g->cells || !g->be || !g->key_be ||
+      screen_resize(&g->screen, rows, cols) < 0 || screen_resize(&g->blank, rows, cols) < 0) {
+    group_destroy(g);
+    return NULL;
+  }
+  // Every cell covers at least one canonical cell, so growing repeats them.
+  g->xs = g->ys + rows + 1;
+  for (int y = 0; y <= rows; y++) g->ys[y] = (int)((long)y * sv->rows / rows);
+  for (int x = 0; x <= cols; x++) g->xs[x] = (int)((long)x * sv->cols / cols);
+  g->be->resize(g->be, rows, cols);
+  g->next = sv->groups;
+  sv->groups = g;
+  return g;
+}
+
+static void group_leave(Server *sv, Group *g) {
+  if (--g->nclients) return;
+  for (Group **p = &sv->groups; *p; p = &(*p)->next)
+    if (*p == g) {
+      *p = g->next;
+      break;
+    }
+  group_destroy(g);
+}
+
+// A full repaint of the group's current frame, encoded at most once a frame.
+static const char *group_keyframe(Group *g, size_t *len) {
+  if (!g->key) {
+    g->key_be->resize(g->key_be, g->rows, g->cols);  // clears the screen
+    screen_resize(&g->blank, g->rows, g->cols);
+    g->key_be->begin_frame(g->key_be);
+    screen_present(&g->blank, g->key_be, g->cells, -1);
+    g->key_be->end_frame(g->key_be);
+    g->key = backend_ansi_output(g->key_be, &g->key_len);
+  }
+  *len = g->key_len;
+  return g->key;
+}
+
+// ---------------------------------------------------------------------------
+// Viewers
+
+static void client_watch(Server *sv, Client *c, int out) {
+  struct epoll_event ev = {0};
+  ev.events = (c->drop ? 0 : EPOLLIN) | (out ? EPOLLOUT : 0);  // leaving: no more input
+  ev.data.ptr = c;
+  epoll_ctl(sv->ep, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+static void client_flush(Server *sv, Client *c);
+
+// Send what the socket takes now and keep the rest for EPOLLOUT, behind
+// anything still pending from before.
+static void client_send(Server *sv, Client *c, const char *buf, size_t len) {
+  size_t off = 0;
+  if (c->pend_len) client_flush(sv, c);
+  while (!c->pend_len && c->drop != DROP_BROKEN && off < len) {
+    ssize_t w = send(c->fd, buf + off, len - off, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (w > 0) {
+      off += (size_t)w;
+    } else if (w < 0 && errno == EINTR) {
+      continue;
+    } else if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    } else {
+      c->drop = DROP_BROKEN;
+      return;
+    }
+  }
+  if (off == len || c->drop == DROP_BROKEN) return;
+  size_t keep = c->pend_len - c->pend_off, rest = len - off;
+  if (keep + rest > c->pend_cap) {
+    char *p = (char *)realloc(c->pend, keep + rest);
+    if (!p) {
+      c->drop = DROP_BROKEN;
+      return;
+    }
+    c->pend = p;
+    c->pend_cap = keep + rest;
+  }
+  memmove(c->pend, c->pend + c->pend_off, keep);
+  memcpy(c->pend + keep, buf + off, rest);
+  c->pend_off = 0;
+  c->pend_len = keep + rest;
+  client_watch(sv, c, 1);
+}
+
+static void client_flush(Server *sv, Client *c) {
+  while (c->pend_off < c->pend_len) {
+    ssize_t w = send(c->fd, c->pend + c->pend_off, c->pend_len - c->pend_off,
+                     MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (w > 0) {
+      c->pend_off += (size_t)w;
+    } else if (w < 0 && errno == EINTR) {
+      continue;
+    } else if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;
+    } else {
+      c->drop = DROP_BROKEN;
+      return;
+    }
+  }
+  c->pend_off = c->pend_len = 0;
+  client_watch(sv, c, 0);
+}
+
+static void client_resize(Server *sv, Client *c, int rows, int cols) {
+  rows = rows < MIN_ROWS ? MIN_ROWS : rows > MAX_ROWS ? MAX_ROWS : rows;
+  cols = cols < MIN_COLS ? MIN_COLS : cols > MAX_COLS ? MAX_COLS : cols;
+  if (c->g && c->g->rows == rows && c->g->cols == cols) return;
+  Group *g = group_get(sv, rows, cols);
+  if (!g) {
+    c->drop = DROP_QUIT;
+    return;
+  }
+  g->nclients++;
+  if (c->g) group_leave(sv, c->g);
+  c->g = g;
+  c->need_key = 1;
+}
+
+static void client_add(Server *sv, int fd, int tcp) {
+  if (sv->nclients == sv->cap) {
+    int cap = sv->cap ? sv->cap * 2 : 16;
+    Client **cl = (Client **)realloc(sv->client, (size_t)cap * sizeof(Client *));
+    if (!cl) {
+      close(fd);
+      return;
+    }
+    sv->client = cl;
+    sv->cap = cap;
+  }
+  Client *c = (Client *)calloc(1, sizeof(*c));
+  if (!c) {
+    close(fd);
+    return;
+  }
+  c->fd = fd;
+  c->tcp = tcp;
+  struct epoll_event ev = {0};
+  ev.events = EPOLLIN;
+  ev.data.ptr = c;
+  epoll_ctl(sv->ep, EPOLL_CTL_ADD, fd, &ev);
+  sv->client[sv->nclients++] = c;
+  if (tcp) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    client_send(sv, c, TELNET_HELLO, sizeof(TELNET_HELLO) - 1);
+  } else {
+    client_send(sv, c, SIZE_QUERY, sizeof(SIZE_QUERY) - 1);
+  }
+  client_send(sv, c, HIDE_CURSOR, sizeof(HIDE_CURSOR) - 1);
+  client_resize(sv, c, DEFAULT_ROWS, DEFAULT_COLS);
+}
+
+static void client_close(Server *sv, int i) {
+  Client *c = sv->client[i];
+  // Shutting down: a best-effort goodbye, after whatever is pending.
+  if (!c->drop) client_send(sv, c, GOODBYE, sizeof(GOODBYE) - 1);
+  close(c->fd);
+  if (c->g) group_leave(sv, c->g);
+  free(c->pend);
+  free(c);
+  sv->client[i] = sv->client[--sv->nclients];
+}
+
+// A finished telnet subnegotiation or CSI sequence.
+static void client_sb(Server *sv, Client *c) {
+  if (c->narg >= 5 && c->arg[0] == NAWS)
+    client_resize(sv, c, c->arg[3] << 8 | c->arg[4], c->arg[1] << 8 | c->arg[2]);
+}
+
+static void client_csi(Server *sv, Client *c, int final) {
+  int kind, rows, cols;
+  c->arg[c->narg] = 0;
+  if (final == 't' && sscanf((const char *)c->arg, "%d;%d;%d", &kind, &rows, &cols) == 3 &&
+      kind == 8)
+    client_resize(sv, c, rows, cols);
+}
+
+static void client_input(Server *sv, Client *c) {
+  unsigned char buf[256];
+  ssize_t n = recv(c->fd, buf, sizeof(buf), MSG_DONTWAIT);
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+    c->drop = DROP_BROKEN;
+    return;
+  }
+  for (ssize_t k = 0; k < n && !c->drop; k++) {
+    unsigned char b = buf[k];
+    switch (c->state) {
+      case IN_DATA:
+        if (b == IAC && c->tcp)                   c->state = IN_IAC;
+        else if (b == 033)                        c->state = IN_ESC;
+        else if (b == 'q' || b == 'Q' || b == 3 || b == 4) c->drop = DROP_QUIT;
+        break;
+      case IN_IAC:
+        if (b == SB)             c->state = IN_SB, c->narg = 0;
+        else if (b >= 251)       c->state = IN_OPT;  // WILL / WONT / DO / DONT
+        else if (b == IP)        c->drop = DROP_QUIT;
+        else                     c->state = IN_DATA;
+        break;
+      case IN_OPT:
+        c->state = IN_DATA;
+        break;
+      case IN_SB:
+        if (b == IAC) c->state = IN_SB_IAC;
+        else if (c->narg < (int)sizeof(c->arg) - 1) c->arg[c->narg++] = b;
+        break;
+      case IN_SB_IAC:
+        if (b == IAC) {
+          if (c->narg < (int)sizeof(c->arg) - 1) c->arg[c->narg++] = b;
+          c->state = IN_SB;
+        } else {
+          if (b == SE) client_sb(sv, c);
+          c->state = IN_DATA;
+        }
+        break;
+      case IN_ESC:
+        c->state = b == '[' ? IN_CSI : IN_DATA;
+        c->narg = 0;
+        break;
+      case IN_CSI:
+        if (b >= 0x40 && b <= 0x7e) {
+          client_csi(sv, c, b);
+          c->state = IN_DATA;
+        } else if (c->narg < (int)sizeof(c->arg) - 1) {
+          c->arg[c->narg++] = b;
+        }
+        break;
+    }
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Frames
+
+static int cell_weight(em_cell c) {
+  return !c.ch ? 0 : (c.attr & EM_BOLD) ? 3 : (c.attr & EM_DIM) ? 1 : 2;
+}
+
+// Shrink or stretch the canonical frame to the group's size. Each cell
+// shows the brightest canonical cell it covers (the first of equals), so
+// thin streams survive shrinking rather than flickering in and out the
+// way a nearest-neighbour pick would make them.
+static void group_resample(Group *g, const em_cell *src, int scols) {
+  em_cell *out = g->cells;
+  for (int y = 0; y < g->rows; y++) {
+    int y0 = g->ys[y], y1 = g->ys[y + 1] > y0 ? g->ys[y + 1] : y0 + 1;
+    for (int x = 0; x < g->cols; x++) {
+      int x0 = g->xs[x], x1 = g->xs[x + 1] > x0 ? g->xs[x + 1] : x0 + 1;
+      em_cell best = src[(size_t)y0 * scols + x0];
+      int bw = cell_weight(best);
+      for (int sy = y0; sy < y1 && bw < 3; sy++)
+        for (int sx = x0; sx < x1; sx++) {
+          em_cell c = src[(size_t)sy * scols + sx];
+          int w = cell_weight(c);
+          if (w > bw) {
+            best = c;
+            bw = w;
+            if (w == 3) break;
+          }
+        }
+      *out++ = best;
+    }
+  }
+}
+
+static void serve_frame(Server *sv, double t) {
+  if (!sv->groups) return;  // nobody watching
+  em_step(sv->sim, t);
+  const em_cell *src = em_cells(sv->sim, NULL, NULL);
+  for (Group *g = sv->groups; g; g = g->next) {
+    group_resample(g, src, sv->cols);
+    g->be->begin_frame(g->be);
+    screen_present(&g->screen, g->be, g->cells, -1);
+    g->be->end_frame(g->be);
+    g->key = NULL;
+  }
+  for (int i = 0; i < sv->nclients; i++) {
+    Client *c = sv->client[i];
+    if (c->drop) continue;
+    // Still sending an older frame: this one is lost, so the next frame
+    // the viewer gets has to be whole.
+    if (c->pend_len) {
+      c->need_key = 1;
+      continue;
+    }
+    size_t len;
+    const char *buf = c->need_key ? group_keyframe(c->g, &len) : backend_ansi_output(c->g->be, &len);
+    c->need_key = 0;
+    client_send(sv, c, buf, len);
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Listening
+
+// Out of file descriptors, the pending connection stays queued and the
+// listening socket stays readable, so stop watching it until a viewer
+// leaves or a moment has passed.
+static void listen_pause(Server *sv, int pause) {
+  struct epoll_event ev = {0};
+  ev.events = pause ? 0 : EPOLLIN;
+  ev.data.ptr = &LISTEN_TAG;
+  epoll_ctl(sv->ep, EPOLL_CTL_MOD, sv->lfd, &ev);
+  sv->listen_paused = pause ? now_seconds() : 0.0;
+}
+
+static int listen_unix(const char *path) {
+  struct sockaddr_un sa = {0};
+  sa.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(sa.sun_path)) {
+    fprintf(stderr, "ematrix: socket path too long: %s\n", path);
+    return -1;
+  }
+  strcpy(sa.sun_path, path);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+  // A socket left behind by a server that has gone is taken over.
+  struct stat st;
+  if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int live = probe >= 0 && connect(probe, (struct sockaddr *)&sa, sizeof(sa)) == 0;
+    if (probe >= 0) close(probe);
+    if (live) {
+      fprintf(stderr, "ematrix: %s is already being served\n", path);
+      close(fd);
+      return -1;
+    }
+    unlink(path);
+  }
+  if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 || listen(fd, 128) < 0) {
+    fprintf(stderr, "ematrix: can't listen on %s: %s\n", path, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int listen_tcp(const char *addr) {
+  char host[256];
+  const char *colon = strrchr(addr, ':');
+  size_t hl = (size_t)(colon - addr);
+  if (hl >= sizeof(host)) return -1;
+  memcpy(host, addr, hl);
+  host[hl] = 0;
+  // An IPv6 host comes bracketed, [::1]:2323; getaddrinfo wants it bare.
+  char *h = host;
+  if (hl >= 2 && host[0] == '[' && host[hl - 1] == ']') {
+    host[hl - 1] = 0;
+    h++;
+  }
+  struct addrinfo hints = {0}, *res;
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  // An empty host is IPv4 loopback (which telnet localhost reaches), not
+  // every interface: serving the network takes an explicit 0.0.0.0 or [::].
+  int err = getaddrinfo(hl ? h : "127.0.0.1", colon + 1, &hints, &res);
+  if (err) {
+    fprintf(stderr, "ematrix: can't resolve %s: %s\n", addr, gai_strerror(err));
+    return -1;
+  }
+  int fd = -1;
+  for (struct addrinfo *ai = res; ai && fd < 0; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+    if (fd < 0) continue;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, ai->ai_addr, ai->ai_addrlen) < 0 || listen(fd, 128) < 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(res);
+  if (fd < 0) fprintf(stderr, "ematrix: can't listen on %s: %s\n", addr, strerror(errno));
+  return fd;
+}
+
+// [HOST]:PORT, with a numeric port and no slash, is TCP; the rest are paths.
+static int is_tcp(const char *addr) {
+  const char *colon = strrchr(addr, ':');
+  return colon && !strchr(addr, '/') && colon[1] &&
+         strspn(colon + 1, "0123456789") == strlen(colon + 1);
+}
+
+int serve(const char *addr, const em_config *cfg, const Palette *pal, int truecolor,
+          int rows, int cols, int frame_us) {
+  Server sv = {0};
+  sv.sim = em_create(cfg, rows, cols);
+  if (!sv.sim) {
+    fprintf(stderr, "ematrix: can't create a %dx%d simulation\n", cols, rows);
+    return 1;
+  }
+  int tcp = is_tcp(addr);
+  int lfd = tcp ? listen_tcp(addr) : listen_unix(addr);
+  if (lfd < 0) {
+    em_destroy(sv.sim);
+    return 1;
+  }
+  sv.lfd = lfd;
+  sv.rows = rows;
+  sv.cols = cols;
+  sv.pal = pal;
+  sv.truecolor = truecolor;
+
+  sigset_t sigs;
+  sigemptyset(&sigs);
+  sigaddset(&sigs, SIGTERM);
+  sigaddset(&sigs, SIGINT);
+  sigaddset(&sigs, SIGHUP);
+  sigprocmask(SIG_BLOCK, &sigs, NULL);
+  sv.ep = epoll_create1(EPOLL_CLOEXEC);
+  int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  int sfd = signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC);
+  struct itimerspec its = {{0, frame_us * 1000L}, {0, frame_us * 1000L}};
+  struct epoll_event ev = {0};
+  ev.events = EPOLLIN;
+  ev.data.ptr = &LISTEN_TAG; epoll_ctl(sv.ep, EPOLL_CTL_ADD, lfd, &ev);
+  ev.data.ptr = &TIMER_TAG;  epoll_ctl(sv.ep, EPOLL_CTL_ADD, tfd, &ev);
+  ev.data.ptr = &SIGNAL_TAG; epoll_ctl(sv.ep, EPOLL_CTL_ADD, sfd, &ev);
+  timerfd_settime(tfd, 0, &its, NULL);
+
+  int status = 0, quit = 0;
+  if (sv.ep < 0 || tfd < 0 || sfd < 0) perror("ematrix: event setup"), status = 1;
+  else fprintf(stderr, "ematrix: serving on %s\n", addr);
+  while (!status && !quit) {
+    struct epoll_event evs[64];
+    int nev = epoll_wait(sv.ep, evs, 64, -1);
+    if (nev < 0 && errno != EINTR) {
+      perror("ematrix: epoll_wait");
+      status = 1;
+    }
+    int tick = 0;
+    for (int e = 0; e < nev; e++) {
+      void *tag = evs[e].data.ptr;
+      if (tag == &TIMER_TAG) {
+        uint64_t expirations;
+        tick = read(tfd, &expirations, sizeof(expirations)) > 0;
+      } else if (tag == &SIGNAL_TAG) {
+        quit = 1;
+      } else if (tag == &LISTEN_TAG) {
+        int fd;
+        while ((fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+          client_add(&sv, fd, tcp);
+        if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+          listen_pause(&sv, 1);
+      } else {
+        Client *c = (Client *)tag;
+        if (evs[e].events & (EPOLLERR | EPOLLHUP)) c->drop = DROP_BROKEN;
+        if (!c->drop && (evs[e].events & EPOLLIN)) client_input(&sv, c);
+        if (c->drop != DROP_BROKEN && (evs[e].events & EPOLLOUT)) client_flush(&sv, c);
+      }
+    }
+    // Drop viewers only here: later events in the batch may point at them.
+    // A viewer that quit first gets the rest of its frame and its terminal
+    // back, for up to LINGER_S.
+    int closed = 0;
+    double now = now_seconds();
+    for (int i = sv.nclients - 1; i >= 0; i--) {
+      Client *c = sv.client[i];
+      if (c->drop == DROP_QUIT && !c->leaving) {
+        c->leaving = now;
+        client_send(&sv, c, GOODBYE, sizeof(GOODBYE) - 1);
+        client_watch(&sv, c, c->pend_len != 0);
+      }
+      if (c->drop == DROP_BROKEN || (c->drop && (!c->pend_len || now - c->leaving > LINGER_S)))
+        client_close(&sv, i), closed = 1;
+    }
+    if (sv.listen_paused && (closed || now - sv.listen_paused > LISTEN_RETRY_S))
+      listen_pause(&sv, 0);
+    // Late frames are dropped, not queued: the clock is real time.
+    if (tick && !quit) serve_frame(&sv, now_seconds());
+  }
+
+  while (sv.nclients) client_close(&sv, sv.nclients - 1);
+  free(sv.client);
+  em_destroy(sv.sim);
+  close(sv.ep); close(tfd); close(sfd); close(lfd);
+  if (!tcp) unlink(addr);
+  return status;
+}
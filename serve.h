@@ -0,0 +1,33 @@
+// Frame broadcast server (--serve): ematrix for many viewers at once, in
+// the spirit of the old telnet movie servers.
+//
+// Viewers connect over a Unix socket or localhost TCP and are grouped by
+// terminal size. One simulation runs at a canonical size; each group
+// resamples its frame to the group's size and encodes the ANSI diff once,
+// and the same bytes go to every viewer in it. So a frame costs one
+// simulation, plus a resample and an encode per size in use, however
+// many people watch.
+// Sends never block: a viewer whose socket is full keeps the rest of its
+// frame pending and misses the frames after it, then catches up with a
+// keyframe (a full repaint of the group's current frame).
+//
+// A viewer's size comes from telnet NAWS on TCP, or from the terminal's
+// reply to a size query (CSI 18 t) on a Unix socket, e.g. through
+//   socat -,rawer UNIX-CONNECT:PATH
+// and is 80x24 until one arrives. 'q' or ^C disconnects.
+
+#ifndef EMATRIX_SERVE_H
+#define EMATRIX_SERVE_H
+
+#include "ematrix.h"
+#include "render.h"
+
+// Serve a rows x cols simulation on addr ([HOST]:PORT for TCP, where no
+// host means loopback, 0.0.0.0 or [::] every interface, and an IPv6 host
+// is bracketed, [::1]:2323; anything else is a Unix socket path) until
+// SIGINT, SIGTERM or SIGHUP, a frame every frame_us. Returns the exit
+// status; errors go to stderr.
+int serve(const char *addr, const em_config *cfg, const Palette *pal, int truecolor,
+          int rows, int cols, int frame_us);
+
+#endif
@@ -0,0 +1,150 @@
+// Steady-state allocation test.
+//
+//   make check            # or: tests/test_allocs
+//
+// malloc and friends are interposed and forwarded to glibc's internal
+// entry points, counting every call made while `counting` is set. Each
+// backend is driven through the same loop as ematrix's main loop
+// (em_step, screen_present between begin_frame and end_frame): first a
+// warm-up, where growing arenas and lazy library state are fine, then
+// the counted frames, which must not allocate at all. The mode switches
+// halfway through both phases so each look is warmed up and then counted
+// (ncurses caches every terminfo string the first time it formats one).
+// ansi_threads runs the simulation and the presenter on worker threads.
+
+#include <ncurses.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ematrix.h"
+#include "render.h"
+
+#define ROWS    60
+#define COLS    200
+#define WARMUP  1000
+#define FRAMES  2000
+
+extern void *__libc_malloc(size_t n);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t n);
+extern void *__libc_memalign(size_t align, size_t n);
+extern void  __libc_free(void *p);
+
+static int counting;
+static long allocs, frees;
+
+void *malloc(size_t n) {
+  if (counting) allocs++;
+  return __libc_malloc(n);
+}
+
+void *calloc(size_t n, size_t size) {
+  if (counting) allocs++;
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t n) {
+  if (counting) allocs++;
+  return __libc_realloc(p, n);
+}
+
+void free(void *p) {
+  if (counting && p) frees++;
+  __libc_free(p);
+}
+
+void *aligned_alloc(size_t align, size_t n) {
+  if (counting) allocs++;
+  return __libc_memalign(align, n);
+}
+
+int posix_memalign(void **out, size_t align, size_t n) {
+  if (counting) allocs++;
+  void *p = __libc_memalign(align, n);
+  if (!p) return 12; // ENOMEM
+  *out = p;
+  return 0;
+}
+
+static int failures;
+
+// threads > 1 also updates, composes and presents on that many threads.
+static void run_backend(const char *name, Backend *be, int threads) {
+  if (!be) {
+    fprintf(stderr, "allocs: skipping %s (backend unavailable)\n", name);
+    return;
+  }
+  em_config cfg;
+  em_config_default(&cfg);
+  cfg.seed = 7;
+  cfg.truecolor = 1;
+  cfg.threads = threads;
+  Workers *pool = threads > 1 ? workers_create(threads) : NULL;
+  cfg.workers = pool;
+  em_ctx *sim = em_create(&cfg, ROWS, COLS);
+  Screen screen = {0};
+  screen.workers = pool;
+  if (!sim || screen_resize(&screen, ROWS, COLS) < 0) {
+    fprintf(stderr, "FAIL: %s: setup failed\n", name);
+    failures++;
+    return;
+  }
+  be->resize(be, ROWS, COLS);
+
+  double t = 0.0;
+  allocs = frees = 0;
+  for (int fr = 0; fr < WARMUP + FRAMES; fr++) {
+    counting = fr >= WARMUP;
+    if (fr == WARMUP / 2 || fr == WARMUP + FRAMES / 2) em_set_mode(sim, !em_mode(sim));
+    em_step(sim, t += 1.0 / 200.0);
+    be->begin_frame(be);
+    // Alternate unlimited and budgeted frames to exercise the limiter.
+    screen_present(&screen, be, em_cells(sim, NULL, NULL), fr & 1 ? 4096 : -1);
+    be->end_frame(be);
+  }
+  counting = 0;
+
+  if (allocs || frees) {
+    fprintf(stderr, "FAIL: %s: %ld allocations, %ld frees in %d steady-state frames\n",
+            name, allocs, frees, FRAMES);
+    failures++;
+  } else {
+    printf("%s: no allocations in %d frames\n", name, FRAMES);
+  }
+  screen_free(&screen);
+  em_destroy(sim);
+  workers_destroy(pool);
+  be->destroy(be);
+}
+
+int main(void) {
+  Palette pal;
+  palette_init(&pal, 256);
+
+  run_backend("null", backend_null(), 1);
+  run_backend("ansi", backend_ansi(&pal, -1, 0, 0), 1);
+  run_backend("ansi_truecolor", backend_ansi(&pal, -1, 1, 1), 1);
+  run_backend("ansi_threads", backend_ansi(&pal, -1, 1, 0), 3);
+  run_backend("recorder", backend_recorder("/dev/null"), 1);
+
+  // ncurses into a private screen on /dev/null, as bench/bench does.
+  FILE *devnull = fopen("/dev/null", "w");
+  SCREEN *scr = devnull ? newterm("xterm-256color", devnull, stdin) : NULL;
+  if (scr) {
+    start_color();
+    resizeterm(ROWS, COLS);
+    run_backend("ncurses", backend_ncurses(&pal, 0), 1);
+    endwin();
+    delscreen(scr);
+  } else {
+    run_backend("ncurses", NULL, 1);
+  }
+  if (devnull) fclose(devnull);
+
+  if (failures) {
+    fprintf(stderr, "%d backend(s) allocated in steady state\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,470 @@
+// Deterministic regression tests for libematrix.
+//
+//   make check                                 # run
+//   tests/test_golden --update tests/golden    # rewrite the goldens after
+//                                              # an intended output change
+//
+// Each scenario runs a seeded context on a virtual 200 fps clock at a
+// fixed size and hashes every composed frame (glyph, pair, attrs and
+// truecolor index). The hashes are compared with tests/golden/NAME.txt,
+// one "frame hash" line per frame. The float math is plain IEEE at -O2
+// with glibc's expf/cosf/sinf, so goldens are only expected to match
+// builds using the same libm. Each scenario is run with every SIMD
+// instruction set the machine supports, and on three threads, and all
+// must match. A video wall of three shards is checked the same way, its
+// whole canvas against a golden and each shard's viewport against that.
+//
+// expA() and its variants are also checked against a double-precision
+// matrix exponential (Taylor series with scaling and squaring), and so is
+// the compact particle decoder (whose SIMD versions must match it bit for
+// bit) and the eigenbasis kernel, and the polynomial exp/sin/cos variants
+// against the bounds in fastmath.h. The glyph mutation skip counters are
+// checked for their mean and range.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ematrix.h"
+#include "kernels.h"
+
+typedef struct {
+  const char *name;
+  int cols, rows;
+  int bh_mode;
+  int truecolor;
+  int frames;
+  int compact;
+  int kernel;
+  int events;
+  int precision;
+  int sort;
+} Scenario;
+
+static const Scenario scenarios[] = {
+  {"green_80x24",  80, 24, 0, 0, 400, 0, 0, 0, 0, 0},
+  {"bh_120x40",   120, 40, 1, 1, 400, 0, 0, 0, 0, 0},
+  {"bh_8color_200x60", 200, 60, 1, 0, 200, 0, 0, 0, 0, 0},
+  {"compact_bh_120x40", 120, 40, 1, 1, 400, 1, 0, 0, 0, 0},
+  {"eigen_green_80x24", 80, 24, 0, 0, 4000, 0, EM_KERNEL_EIGEN, 0, 0, 0},
+  {"events_green_120x40", 120, 40, 0, 1, 800, 0, 0, 1, 0, 0},
+  {"fast_bh_120x40", 120, 40, 1, 1, 400, 0, 0, 0, EM_PRECISION_FAST, 0},
+  {"sort_bh_120x40", 120, 40, 1, 1, 400, 0, 0, 0, 0, 1},
+  {"sort_compact_green_200x60", 200, 60, 0, 0, 200, 1, 0, 0, 0, 1},
+};
+
+static int failures;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { failures++; fprintf(stderr, "FAIL: " __VA_ARGS__); fputc('\n', stderr); } \
+  } while (0)
+
+// FNV-1a over the visible part of each cell.
+static uint64_t frame_hash(const em_cell *cells, int n) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (int i = 0; i < n; i++) {
+    const unsigned char b[4] = {(unsigned char)cells[i].ch, cells[i].pair,
+                                cells[i].attr, cells[i].tc};
+    for (int k = 0; k < 4; k++) h = (h ^ b[k]) * 0x100000001b3ULL;
+  }
+  return h;
+}
+
+static const char *isa_names[] = {"auto", "sse2", "avx2", "avx512"};
+
+static void run_scenario(const Scenario *sc, const char *dir, int update, int isa,
+                         int threads) {
+  char label[128];
+  snprintf(label, sizeof(label), "%s/%s%s", sc->name, isa_names[isa],
+           threads > 1 ? "/threads" : "");
+  em_config cfg;
+  em_config_default(&cfg);
+  cfg.seed = 12345;
+  cfg.truecolor = sc->truecolor;
+  cfg.compact = sc->compact;
+  cfg.kernel = sc->kernel;
+  cfg.events = sc->events;
+  cfg.precision = sc->precision;
+  cfg.sort = sc->sort;
+  cfg.isa = isa;
+  cfg.threads = threads;
+  if (!sc->truecolor) cfg.bh_pair_base = 10, cfg.bh_pair_count = 7;
+  em_ctx *sim = em_create(&cfg, sc->rows, sc->cols);
+  if (!sim) {
+    CHECK(0, "%s: em_create failed", label);
+    return;
+  }
+  em_set_mode(sim, sc->bh_mode);
+
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s.txt", dir, sc->name);
+  FILE *f = fopen(path, update ? "w" : "r");
+  if (!f) {
+    CHECK(0, "%s: can't open %s", sc->name, path);
+    em_destroy(sim);
+    return;
+  }
+
+  int bad = 0;
+  for (int fr = 0; fr < sc->frames; fr++) {
+    em_step(sim, (double)fr / 200.0);
+    int rows, cols;
+    const em_cell *cells = em_cells(sim, &rows, &cols);
+    uint64_t h = frame_hash(cells, rows * cols);
+    if (update) {
+      fprintf(f, "%d %016llx\n", fr, (unsigned long long)h);
+      continue;
+    }
+    int gfr;
+    unsigned long long gh;
+    if (fscanf(f, "%d %llx", &gfr, &gh) != 2 || gfr != fr) {
+      CHECK(0, "%s: golden file ends or is out of step at frame %d", label, fr);
+      break;
+    }
+    if (gh != h && !bad++)
+      CHECK(0, "%s: frame %d hash %016llx, golden %016llx", label, fr,
+            (unsigned long long)h, gh);
+  }
+  if (bad > 1)
+    fprintf(stderr, "      (%s: %d frames differ in total)\n", label, bad);
+  fclose(f);
+  em_destroy(sim);
+}
+
+// A wall of nshards shards side by side on a rows x cols canvas, each
+// shard's context composing a viewport of its own column, stepped in
+// lockstep with a compose-only context that views the whole canvas. The
+// columns must add up to the whole, and the whole must match the golden
+// when there is one (dir non-NULL).
+static void run_wall(const char *name, int kernel, int compact, int frames, int rows,
+                     int cols, const char *dir, int update) {
+  enum { SHARDS = 3 };
+  em_config cfg;
+  em_config_default(&cfg);
+  cfg.seed = 12345;
+  cfg.truecolor = 1;
+  cfg.kernel = kernel;
+  cfg.compact = compact;
+  size_t size = em_wall_size(&cfg, rows, cols, SHARDS);
+  void *arena = calloc(1, size);
+  if (!arena || em_wall_format(arena, &cfg, rows, cols, SHARDS) < 0) {
+    CHECK(0, "%s: em_wall_format failed", name);
+    free(arena);
+    return;
+  }
+  em_ctx *whole = em_wall_attach(arena, &cfg, -1, 0, 0, rows, cols);
+  em_ctx *shard[SHARDS];
+  int x0[SHARDS + 1];
+  for (int s = 0; s <= SHARDS; s++) x0[s] = cols * s / SHARDS;
+  for (int s = 0; s < SHARDS; s++)
+    shard[s] = em_wall_attach(arena, &cfg, s, 0, x0[s], rows, x0[s + 1] - x0[s]);
+  CHECK(whole && shard[0] && shard[1] && shard[2], "%s: em_wall_attach failed", name);
+
+  FILE *f = NULL;
+  if (dir && whole) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s.txt", dir, name);
+    f = fopen(path, update ? "w" : "r");
+    CHECK(f, "%s: can't open %s", name, path);
+  }
+  int bad = 0, torn = 0;
+  for (int fr = 0; fr < frames && whole && shard[0] && shard[1] && shard[2]; fr++) {
+    double t = (double)fr / 200.0;
+    em_set_mode(whole, 1);
+    for (int s = 0; s < SHARDS; s++) em_set_mode(shard[s], 1), em_update(shard[s], t);
+    em_compose(whole);
+    const em_cell *all = em_cells(whole, NULL, NULL);
+    for (int s = 0; s < SHARDS; s++) {
+      em_compose(shard[s]);
+      int vr, vc;
+      const em_cell *v = em_cells(shard[s], &vr, &vc);
+      for (int y = 0; y < vr; y++)
+        if (memcmp(v + y * vc, all + y * cols + x0[s], (size_t)vc * sizeof(em_cell))) {
+          if (!torn++) CHECK(0, "%s: shard %d's viewport differs at frame %d", name, s, fr);
+          break;
+        }
+    }
+    if (!f) continue;
+    uint64_t h = frame_hash(all, rows * cols);
+    if (update) {
+      fprintf(f, "%d %016llx\n", fr, (unsigned long long)h);
+      continue;
+    }
+    int gfr;
+    unsigned long long gh;
+    if (fscanf(f, "%d %llx", &gfr, &gh) != 2 || gfr != fr) {
+      CHECK(0, "%s: golden file ends or is out of step at frame %d", name, fr);
+      break;
+    }
+    if (gh != h && !bad++)
+      CHECK(0, "%s: frame %d hash %016llx, golden %016llx", name, fr,
+            (unsigned long long)h, gh);
+  }
+  if (f) fclose(f);
+  // Each shard counts only its own particles; the whole canvas updates none.
+  if (whole && shard[0] && shard[1] && shard[2]) {
+    em_stats st;
+    em_get_stats(whole, &st);
+    int n = st.particles, sum = 0;
+    CHECK(st.updated == 0, "%s: the compose-only context updated %d", name, st.updated);
+    for (int s = 0; s < SHARDS; s++) em_get_stats(shard[s], &st), sum += st.updated;
+    CHECK(sum == n, "%s: shards updated %d of %d particles", name, sum, n);
+  }
+  em_destroy(whole);
+  for (int s = 0; s < SHARDS; s++) em_destroy(shard[s]);
+  free(arena);
+}
+
+// exp(A t) in double: scale t down until the series converges fast,
+// sum it, then square back up.
+static void expA_ref(double t, double M[2][2]) {
+  const double A[2][2] = {{-1.0, -1.0}, {1.0, 0.0}};
+  int sq = 0;
+  double h = t;
+  while (fabs(h) > 0.125) h *= 0.5, sq++;
+
+  double S[2][2] = {{1, 0}, {0, 1}}, T[2][2] = {{1, 0}, {0, 1}};
+  for (int k = 1; k <= 20; k++) {
+    double N[2][2];
+    for (int i = 0; i < 2; i++)
+      for (int j = 0; j < 2; j++)
+        N[i][j] = (T[i][0] * A[0][j] + T[i][1] * A[1][j]) * h / k;
+    memcpy(T, N, sizeof(T));
+    for (int i = 0; i < 2; i++)
+      for (int j = 0; j < 2; j++) S[i][j] += T[i][j];
+  }
+  while (sq--) {
+    double N[2][2];
+    for (int i = 0; i < 2; i++)
+      for (int j = 0; j < 2; j++)
+        N[i][j] = S[i][0] * S[0][j] + S[i][1] * S[1][j];
+    memcpy(S, N, sizeof(S));
+  }
+  memcpy(M, S, sizeof(S));
+}
+
+// Largest entry error, relative to the size of exp(A t) itself (which
+// decays like e^{-t/2}), over ages 0..40.
+static double expA_error(void (*fn)(float, float[2][2])) {
+  double worst = 0.0;
+  for (int i = 0; i <= 4000; i++) {
+    float t = 0.01f * (float)i;
+    float M[2][2];
+    double R[2][2];
+    fn(t, M);
+    expA_ref((double)t, R);
+    double scale = exp(-0.5 * (double)t);
+    for (int r = 0; r < 2; r++)
+      for (int c = 0; c < 2; c++) {
+        double e = fabs((double)M[r][c] - R[r][c]) / scale;
+        if (e > worst) worst = e;
+      }
+  }
+  return worst;
+}
+
+static void check_expA(void) {
+  expA_lut_init();
+  double e_scalar = expA_error(expA);
+  double e_lut = expA_error(expA_lut);
+  CHECK(e_scalar < 1e-5, "expA: relative error %.3g", e_scalar);
+  CHECK(e_lut < 1e-4, "expA_lut: relative error %.3g", e_lut);
+
+  // The incremental form drifts with the number of steps; after 40 s of
+  // 200 fps frames it still has to be well under a cell.
+  float E[2][2], M[2][2];
+  double R[2][2], worst = 0.0;
+  const float h = 1.35f / 200.0f;
+  expA(h, E);
+  expA(0.0f, M);
+  for (int k = 1; k <= 8000; k++) {
+    expA_advance(M, E);
+    expA_ref((double)k * (double)h, R);
+    double scale = exp(-0.5 * (double)k * (double)h);
+    for (int r = 0; r < 2; r++)
+      for (int c = 0; c < 2; c++) {
+        double e = fabs((double)M[r][c] - R[r][c]) / scale;
+        if (e > worst) worst = e;
+      }
+  }
+  CHECK(worst < 1e-3, "expA_advance: relative error %.3g after 8000 steps", worst);
+  printf("expA relative error: scalar %.2g, lut %.2g, incremental %.2g\n",
+         e_scalar, e_lut, worst);
+}
+
+// The polynomial expA variants, as the error in screen position over the
+// distance from the center (x counts double, as on screen), for ages 0..40
+// and initial vectors all around. fastmath.h documents these bounds.
+static double precision_error(void (*fn)(float, float[2][2])) {
+  double worst = 0.0;
+  for (int i = 0; i <= 4000; i++) {
+    float t = 0.01f * (float)i;
+    float M[2][2];
+    double R[2][2];
+    fn(t, M);
+    expA_ref((double)t, R);
+    for (int k = 0; k < 64; k++) {
+      double a = 2.0 * M_PI * k / 64.0, x0 = cos(a), y0 = sin(a);
+      double rx = R[0][0] * x0 + R[0][1] * y0, ry = R[1][0] * x0 + R[1][1] * y0;
+      double ex = M[0][0] * x0 + M[0][1] * y0 - rx, ey = M[1][0] * x0 + M[1][1] * y0 - ry;
+      double e = hypot(2.0 * ex, ey) / hypot(2.0 * rx, ry);
+      if (e > worst) worst = e;
+    }
+  }
+  return worst;
+}
+
+static void check_precision(void) {
+  double e_fast = precision_error(expA_fast);
+  double e_bal = precision_error(expA_balanced);
+  double e_exact = precision_error(expA);
+  CHECK(e_fast < 3e-4, "expA_fast: position error %.3g of the distance", e_fast);
+  CHECK(e_bal < 1e-5, "expA_balanced: position error %.3g of the distance", e_bal);
+  printf("position error per cell of distance: fast %.2g, balanced %.2g, exact %.2g\n",
+         e_fast, e_bal, e_exact);
+}
+
+// decode_compact() against the exact trajectory of the quantized particle
+// it decodes, in cells, for particles across a 200-column screen.
+static void check_compact(void) {
+  enum { N = 4096 };
+  static ParticleC p[N];
+  static int idx[N];
+  static float vx[N], vy[N];
+  uint64_t rng = 99;
+  for (int i = 0; i < N; i++) idx[i] = i;
+  respawn_compact(p, idx, N, 60, 200, 0, 1.52f, &rng);
+
+  double worst = 0.0;
+  for (int tick = 0; tick < 4000; tick += 7) {
+    decode_compact(p, N, (uint16_t)tick, 1.35f, vx, vy);
+    double R[2][2];
+    expA_ref(1.35 * tick / PC_TICK_HZ, R);
+    for (int i = 0; i < N; i++) {
+      double r0 = exp((double)PC_LR_MIN + p[i].lr / (double)PC_LR_RES);
+      double a = 2.0 * M_PI * p[i].angle / 65536.0;
+      double x0 = r0 * cos(a), y0 = r0 * sin(a);
+      double ex = fabs(vx[i] - (R[0][0] * x0 + R[0][1] * y0));
+      double ey = fabs(vy[i] - (R[1][0] * x0 + R[1][1] * y0));
+      if (ex > worst) worst = ex;
+      if (ey > worst) worst = ey;
+    }
+  }
+  CHECK(worst < 0.05, "decode_compact: error %.3g cells", worst);
+  printf("decode_compact error: %.2g cells\n", worst);
+
+  // Every instruction set's version must match it bit for bit, past the
+  // end of the tables too, with a ragged tail.
+  static float sx[N], sy[N];
+  for (int isa = EM_ISA_SSE2; isa <= EM_ISA_AVX512; isa++) {
+    const KernelSet *ks = kernel_set(isa);
+    if (!ks) continue;
+    int bad = 0;
+    for (int tick = 0; tick < 6000 && !bad; tick += 13) {
+      decode_compact(p, N - 3, (uint16_t)tick, 1.35f, vx, vy);
+      ks->decode_compact(p, N - 3, (uint16_t)tick, 1.35f, sx, sy);
+      bad = memcmp(vx, sx, (N - 3) * sizeof(float)) || memcmp(vy, sy, (N - 3) * sizeof(float));
+    }
+    CHECK(!bad, "decode_compact/%s differs from the scalar decoder", ks->name);
+  }
+}
+
+// The eigenbasis kernel against exp(A t) v0 for particles born over a
+// span that forces several epoch rebases, relative to the size of the
+// exact position.
+static void check_eigen(void) {
+  enum { N = 1024 };
+  static Particle p[N];
+  static int idx[N];
+  static float vx[N], vy[N];
+  double x0[N], y0[N], born[N];
+  uint64_t rng = 5;
+  double E = 0.0, worst = 0.0;
+  for (int i = 0; i < N; i++) {
+    idx[i] = i;
+    born[i] = 0.05 * i;
+    p[i].vx0 = (float)(x0[i] = rng_float(&rng, -50.0f, 50.0f));
+    p[i].vy0 = (float)(y0[i] = rng_float(&rng, -50.0f, 50.0f));
+    eigen_from_xy(p, &idx[i], 1, eigen_factor(-born[i]));
+  }
+  for (double T = born[N - 1]; T < 120.0; T += 0.25) {
+    if (T - E > 20.0) {
+      eigen_rebase(p, N, eigen_factor(T - E));
+      E = T;
+    }
+    eigen_positions(p, N, eigen_factor(T - E), vx, vy);
+    for (int i = 0; i < N; i++) {
+      double R[2][2];
+      expA_ref(T - born[i], R);
+      double ex = R[0][0] * x0[i] + R[0][1] * y0[i];
+      double ey = R[1][0] * x0[i] + R[1][1] * y0[i];
+      double scale = exp(-0.5 * (T - born[i])) * hypot(x0[i], y0[i]);
+      double e = fmax(fabs(vx[i] - ex), fabs(vy[i] - ey)) / scale;
+      if (e > worst) worst = e;
+    }
+  }
+  CHECK(worst < 1e-4, "eigen kernel: relative error %.3g", worst);
+  printf("eigen kernel relative error: %.2g\n", worst);
+}
+
+// mutate_skip() over counter-based draws: mean MUTATE_ODDS (the standard
+// error over N draws is about 0.03) and within 1..458.
+static void check_mutate(void) {
+  enum { N = 1 << 20 };
+  double sum = 0.0;
+  unsigned lo = ~0u, hi = 0;
+  for (uint32_t i = 0; i < N; i++) {
+    unsigned s = mutate_skip((uint32_t)ctr_rand(7, i, 3));
+    sum += s;
+    if (s < lo) lo = s;
+    if (s > hi) hi = s;
+  }
+  double mean = sum / N;
+  CHECK(fabs(mean - MUTATE_ODDS) < 0.2, "mutate_skip: mean %.3f", mean);
+  CHECK(lo >= 1 && hi <= 458, "mutate_skip: range %u..%u", lo, hi);
+  printf("mutate_skip mean: %.3f (%u..%u)\n", mean, lo, hi);
+}
+
+int main(int argc, char **argv) {
+  int update = 0;
+  const char *dir = "tests/golden";
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--update")) update = 1;
+    else dir = argv[i];
+  }
+
+  check_expA();
+  check_precision();
+  check_compact();
+  check_eigen();
+  check_mutate();
+  // Every instruction set this machine has must reproduce the goldens.
+  for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+    for (int isa = EM_ISA_SSE2; isa <= EM_ISA_AVX512; isa++)
+      if (em_isa_supported(isa) && (!update || isa == EM_ISA_SSE2))
+        run_scenario(&scenarios[i], dir, update, isa, 1);
+  // So must a context that updates and composes on several threads.
+  for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]) && !update; i++)
+    run_scenario(&scenarios[i], dir, 0, EM_ISA_AUTO, 3);
+
+  // A video wall, including the eigenbasis kernel across rebases and
+  // compact particles.
+  run_wall("wall_bh_240x40", EM_KERNEL_EXPA, 0, 400, 40, 240, dir, update);
+  if (!update) {
+    run_wall("wall_eigen", EM_KERNEL_EIGEN, 0, 4000, 24, 90, NULL, 0);
+    run_wall("wall_compact", EM_KERNEL_EXPA, 1, 400, 40, 240, NULL, 0);
+  }
+
+  if (update) {
+    printf("goldens written to %s\n", dir);
+    return failures ? 1 : 0;
+  }
+  if (failures) {
+    fprintf(stderr, "%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("all golden frames match\n");
+  return 0;
+}
@@ -0,0 +1,158 @@
+// Frame ring test.
+//
+//   make check            # or: tests/test_publish
+//
+// Publishes simulation frames and reads them back through the reader
+// helpers, follows the writer when the frame outgrows the ring, and then
+// races a writer thread against a reader: every frame the reader accepts
+// must be whole (each cell encodes its frame number) and newer than the
+// last. The ring lives in /dev/shm under a per-process name.
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ematrix.h"
+#include "publish.h"
+
+#define RACE_ROWS   50
+#define RACE_COLS   160
+#define RACE_FRAMES 20000
+
+static int failures;
+static char name[64];
+
+static void fail(const char *what) {
+  fprintf(stderr, "FAIL: %s\n", what);
+  failures++;
+}
+
+static void check_round_trip(void) {
+  em_config cfg;
+  em_config_default(&cfg);
+  cfg.seed = 7;
+  em_ctx *sim = em_create(&cfg, 40, 120);
+  Publisher *p = publish_open(name, 40, 120);
+  PublishReader *r = p ? publish_attach(name) : NULL;
+  em_cell *buf = (em_cell *)malloc(60 * 200 * sizeof(em_cell));
+  if (!sim || !p || !r || !buf) {
+    fail("round trip: setup failed");
+    return;
+  }
+  PublishFrame f;
+  if (publish_read(r, buf, 40 * 120, &f) != 0) fail("round trip: a frame before any was published");
+
+  // Only the newest frame is read.
+  for (int i = 1; i <= 10; i++) {
+    em_step(sim, i * 0.01);
+    publish_frame(p, em_cells(sim, NULL, NULL), 40, 120, i * 0.01);
+  }
+  if (publish_read(r, buf, 40 * 120, &f) != 1 || f.frame != 10 || f.rows != 40 ||
+      f.cols != 120 || f.t != 0.1 || f.time_ns <= 0 ||
+      memcmp(buf, em_cells(sim, NULL, NULL), 40 * 120 * sizeof(em_cell)))
+    fail("round trip: newest frame");
+  if (publish_read(r, buf, 40 * 120, &f) != 0) fail("round trip: frame read twice");
+
+  // A bigger frame moves the writer to a new segment; the reader follows.
+  em_resize(sim, 60, 200);
+  em_step(sim, 0.2);
+  publish_frame(p, em_cells(sim, NULL, NULL), 60, 200, 0.2);
+  if (publish_read(r, buf, 40 * 120, &f) != 0 || f.rows != 60 || f.cols != 200)
+    fail("round trip: frame too big for the buffer");
+  if (publish_read(r, buf, 60 * 200, &f) != 1 || f.frame != 11 ||
+      memcmp(buf, em_cells(sim, NULL, NULL), 60 * 200 * sizeof(em_cell)))
+    fail("round trip: frame after the ring grew");
+
+  // Zero-copy.
+  em_step(sim, 0.3);
+  publish_frame(p, em_cells(sim, NULL, NULL), 60, 200, 0.3);
+  uint32_t seq;
+  const PublishSlot *s = publish_begin(r, &seq);
+  if (!s || s->frame != 12 ||
+      memcmp(s->cells, em_cells(sim, NULL, NULL), 60 * 200 * sizeof(em_cell)) ||
+      !publish_end(r, s, seq) || publish_begin(r, &seq))
+    fail("round trip: zero-copy read");
+
+  publish_close(p);
+  if (publish_read(r, buf, 60 * 200, &f) != -1) fail("round trip: writer gone");
+  publish_detach(r);
+  if (publish_attach(name)) fail("round trip: ring left behind");
+  free(buf);
+  em_destroy(sim);
+}
+
+static _Atomic int race_done;
+
+static void *race_writer(void *arg) {
+  Publisher *p = (Publisher *)arg;
+  em_cell *cells = (em_cell *)malloc(RACE_ROWS * RACE_COLS * sizeof(em_cell));
+  for (uint64_t f = 1; cells && f <= RACE_FRAMES; f++) {
+    for (int i = 0; i < RACE_ROWS * RACE_COLS; i++) {
+      cells[i].ch = (char)f;
+      cells[i].pair = (unsigned char)(f >> 8);
+      cells[i].attr = (unsigned char)(f >> 16);
+      cells[i].prio = (unsigned char)i;
+      cells[i].tc = 0;
+    }
+    publish_frame(p, cells, RACE_ROWS, RACE_COLS, (double)f);
+  }
+  free(cells);
+  atomic_store(&race_done, 1);
+  return NULL;
+}
+
+static void check_race(void) {
+  Publisher *p = publish_open(name, RACE_ROWS, RACE_COLS);
+  PublishReader *r = p ? publish_attach(name) : NULL;
+  em_cell *buf = (em_cell *)malloc(RACE_ROWS * RACE_COLS * sizeof(em_cell));
+  pthread_t th;
+  if (!p || !r || !buf || pthread_create(&th, NULL, race_writer, p)) {
+    fail("race: setup failed");
+    return;
+  }
+  uint64_t last = 0;
+  long frames = 0, bad = 0;
+  for (;;) {
+    int done = atomic_load(&race_done);
+    PublishFrame f;
+    int got = publish_read(r, buf, RACE_ROWS * RACE_COLS, &f);
+    if (got == 1) {
+      frames++;
+      if (f.frame <= last || f.t != (double)f.frame) bad++;
+      for (int i = 0; i < RACE_ROWS * RACE_COLS; i++)
+        if (buf[i].ch != (char)f.frame || buf[i].pair != (unsigned char)(f.frame >> 8) ||
+            buf[i].attr != (unsigned char)(f.frame >> 16) || buf[i].prio != (unsigned char)i) {
+          bad++;
+          break;
+        }
+      last = f.frame;
+    } else if (done) {
+      break;
+    } else {
+      sched_yield();
+    }
+  }
+  pthread_join(th, NULL);
+  if (bad) fprintf(stderr, "FAIL: race: %ld of %ld frames torn or out of order\n", bad, frames), failures++;
+  else if (last != RACE_FRAMES) fail("race: the last frame was never read");
+  else printf("race: %ld whole frames of %d read\n", frames, RACE_FRAMES);
+  publish_close(p);
+  publish_detach(r);
+  free(buf);
+}
+
+int main(void) {
+  snprintf(name, sizeof(name), "test-%d", (int)getpid());
+  check_round_trip();
+  check_race();
+  if (failures) {
+    fprintf(stderr, "%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("frame ring reads back whole frames\n");
+  return 0;
+}
@@ -0,0 +1,180 @@
+// Trace-event recorder (see trace.h).
+//
+// Each thread gets a single-producer / single-consumer ring the first time
+// it records an event. The producer only ever advances head and the
+// flusher only ever advances tail, so neither side takes a lock. A full
+// ring drops the event (counted, and reported in the file) rather than
+// stall the frame.
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#define RING_SIZE   8192  // events per thread, a power of two
+#define MAX_THREADS 64
+#define FLUSH_MS    50
+
+typedef struct {
+  uint64_t    ts_ns;
+  const char *name;
+  char        phase;
+} Event;
+
+typedef struct {
+  _Atomic uint32_t head, tail;
+  _Atomic long dropped;
+  _Atomic(const char *) thread_name;
+  const char *named;    // flusher side: name already written
+  int tid;
+  Event ev[RING_SIZE];
+} Ring;
+
+int trace_enabled;
+
+static FILE *out;
+static int pid;
+static Ring *_Atomic rings[MAX_THREADS];
+static _Atomic int nrings;
+static _Atomic int stopping;
+static pthread_t flusher;
+static int first_event;
+static __thread Ring *my_ring;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// The calling thread's ring, registered on first use. NULL once every
+// slot is taken; that thread's events are then ignored.
+static Ring *ring_self(void) {
+  if (my_ring) return my_ring;
+  int i = atomic_fetch_add(&nrings, 1);
+  if (i >= MAX_THREADS) return NULL;
+  Ring *r = (Ring *)calloc(1, sizeof(*r));
+  if (!r) return NULL;
+  r->tid = gettid();
+  atomic_store_explicit(&rings[i], r, memory_order_release);
+  return my_ring = r;
+}
+
+void trace_event(const char *name, char phase) {
+  Ring *r = ring_self();
+  if (!r) return;
+  uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  uint32_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+  if (head - tail == RING_SIZE) {
+    atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+    return;
+  }
+  Event *e = &r->ev[head & (RING_SIZE - 1)];
+  e->ts_ns = now_ns();
+  e->name = name;
+  e->phase = phase;
+  atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+void trace_thread_name(const char *name) {
+  if (!trace_enabled) return;
+  Ring *r = ring_self();
+  if (r) atomic_store_explicit(&r->thread_name, name, memory_order_release);
+}
+
+static void emit_sep(void) {
+  fputs(first_event ? "\n" : ",\n", out);
+  first_event = 0;
+}
+
+static void drain(Ring *r) {
+  const char *name = atomic_load_explicit(&r->thread_name, memory_order_acquire);
+  if (name && name != r->named) {
+    emit_sep();
+    fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                 "\"args\":{\"name\":\"%s\"}}", pid, r->tid, name);
+    r->named = name;
+  }
+  uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  uint32_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+  for (; tail != head; tail++) {
+    const Event *e = &r->ev[tail & (RING_SIZE - 1)];
+    emit_sep();
+    fprintf(out, "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":%d,\"tid\":%d}",
+            e->name, e->phase, (unsigned long long)(e->ts_ns / 1000),
+            (unsigned)(e->ts_ns % 1000), pid, r->tid);
+  }
+  atomic_store_explicit(&r->tail, tail, memory_order_release);
+}
+
+static void drain_all(void) {
+  int n = atomic_load(&nrings);
+  if (n > MAX_THREADS) n = MAX_THREADS;
+  for (int i = 0; i < n; i++) {
+    Ring *r = atomic_load_explicit(&rings[i], memory_order_acquire);
+    if (r) drain(r);
+  }
+}
+
+static void *flush_main(void *arg) {
+  (void)arg;
+  const struct timespec nap = {0, FLUSH_MS * 1000000L};
+  while (!atomic_load(&stopping)) {
+    nanosleep(&nap, NULL);
+    drain_all();
+  }
+  return NULL;
+}
+
+int trace_open(const char *path) {
+  out = fopen(path, "w");
+  if (!out) return -1;
+  pid = getpid();
+  first_event = 1;
+  fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", out);
+  // The flusher is started with every signal blocked so it never takes
+  // one meant for the main thread's signalfd.
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  int err = pthread_create(&flusher, NULL, flush_main, NULL);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (err) {
+    fclose(out);
+    out = NULL;
+    errno = err;
+    return -1;
+  }
+  trace_enabled = 1;
+  return 0;
+}
+
+void trace_close(void) {
+  if (!out) return;
+  trace_enabled = 0;
+  atomic_store(&stopping, 1);
+  pthread_join(flusher, NULL);
+  drain_all();
+
+  long dropped = 0;
+  int n = atomic_load(&nrings);
+  if (n > MAX_THREADS) n = MAX_THREADS;
+  for (int i = 0; i < n; i++) {
+    Ring *r = atomic_load(&rings[i]);
+    if (!r) continue;
+    dropped += atomic_load(&r->dropped);
+    free(r);
+    atomic_store(&rings[i], NULL);
+  }
+  fprintf(out, "\n],\"otherData\":{\"dropped_events\":%ld}}\n", dropped);
+  fclose(out);
+  out = NULL;
+}
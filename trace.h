@@ -0,0 +1,33 @@
+// Chrome / Perfetto trace-event export of frame phases.
+//
+// trace_begin/trace_end record a span on the calling thread. Events go
+// into a lock-free ring owned by that thread; a background flusher drains
+// every ring into a trace-event JSON file, which chrome://tracing and
+// ui.perfetto.dev both open. With tracing off each call is one load and
+// a branch. Span names must be string literals (only the pointer is kept).
+
+#ifndef EMATRIX_TRACE_H
+#define EMATRIX_TRACE_H
+
+extern int trace_enabled;
+
+// Start writing to path. Returns -1 (errno set) if it can't be created.
+int  trace_open(const char *path);
+// Stop the flusher, drain what's left and finish the file. Threads that
+// record events must be done by then.
+void trace_close(void);
+
+// Label the calling thread in the viewer.
+void trace_thread_name(const char *name);
+
+void trace_event(const char *name, char phase);
+
+static inline void trace_begin(const char *name) {
+  if (trace_enabled) trace_event(name, 'B');
+}
+
+static inline void trace_end(const char *name) {
+  if (trace_enabled) trace_event(name, 'E');
+}
+
+#endif
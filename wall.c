@@ -0,0 +1,421 @@
+// Video wall over POSIX shared memory (see wall.h).
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "wall.h"
+
+#define WALL_SHM_MAGIC 0x326d68736c6c6177ULL  // "wallshm2"
+#define HEAD_SIZE      4096                    // the arena starts on the next page
+#define POLL_MS        100                     // how often waiters look for the dead
+#define STALL_MS       250                     // how long the host waits for a renderer
+#define SPINS          64                      // checks before sleeping on a futex
+
+// A shard's update token: the frame it was last taken for, with BUSY set
+// while someone is in em_update on it. Frames are counted mod 2^31 here.
+#define BUSY       0x80000000u
+#define FRAME_MASK 0x7fffffffu
+
+// The start of the segment. The host fills in t and owner[] before it
+// bumps frame; the counters are futex words.
+typedef struct {
+  uint64_t magic;
+  size_t size;                // the whole segment
+  int rows, cols, nshards;
+  _Atomic int host;           // the host's pid, 0 once it has gone
+
+  double t;                   // the frame's clock, seconds since the wall began
+  int owner[WALL_MAX_SHARDS]; // who updates each shard this frame: pid, 0 for the host
+  _Atomic uint32_t frame;     // the frame in flight
+  _Atomic uint32_t updated;   // shards updated this frame (the update barrier)
+  _Atomic uint32_t done;      // bumped as renderers finish, to wake the host
+  _Atomic uint32_t did_update[WALL_MAX_SHARDS];  // frame each shard was last updated
+  _Atomic uint32_t did_draw[WALL_MAX_SHARDS];    // frame each owner last finished
+  _Atomic uint32_t token[WALL_MAX_SHARDS];       // who may update each shard (BUSY, ...)
+  _Atomic uint32_t stalled[WALL_MAX_SHARDS];     // owner missed a deadline; the host has
+                                                 // the shard until the owner is back
+  _Atomic int claim[WALL_MAX_SHARDS];            // pid holding each shard, 0 if free
+} WallHead;
+
+_Static_assert(sizeof(WallHead) <= HEAD_SIZE, "wall header outgrew its page");
+
+struct Wall {
+  WallHead *head;
+  size_t size;
+  int shard;
+  int pid;
+  uint32_t seen;              // the last frame number looked at
+  em_ctx *ctx;
+};
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Shared (not process-private) futexes: the waiters are other processes.
+// Returns -1 with errno ETIMEDOUT when ms ran out.
+static int futex_wait(_Atomic uint32_t *word, uint32_t val, int ms) {
+  struct timespec ts = {ms / 1000, (long)(ms % 1000) * 1000000L};
+  return (int)syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT, val, &ts, NULL, 0);
+}
+
+static void futex_wake(_Atomic uint32_t *word) {
+  syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static int alive(int pid) {
+  return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+static int host_alive(WallHead *h) {
+  return alive(atomic_load_explicit(&h->host, memory_order_relaxed));
+}
+
+static int shm_path(const char *name, char *path, size_t len) {
+  if (!*name || strchr(name, '/') ||
+      (size_t)snprintf(path, len, "/ematrix-wall-%s", name) >= len) {
+    fprintf(stderr, "ematrix: bad wall name '%s'\n", name);
+    return -1;
+  }
+  return 0;
+}
+
+// A mapping of the whole segment behind fd, checked to be a wall.
+static WallHead *map_wall(int fd, size_t *size) {
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < HEAD_SIZE) return NULL;
+  void *m = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (m == MAP_FAILED) return NULL;
+  WallHead *h = (WallHead *)m;
+  if (h->magic != WALL_SHM_MAGIC || h->size != (size_t)st.st_size) {
+    munmap(m, (size_t)st.st_size);
+    return NULL;
+  }
+  *size = (size_t)st.st_size;
+  return h;
+}
+
+// Take shard s's update for frame f: 1 if the caller may run em_update on
+// it, 0 if someone already took f or is still updating an older frame.
+static int token_take(WallHead *h, int s, uint32_t f) {
+  uint32_t old = atomic_load_explicit(&h->token[s], memory_order_acquire);
+  return !(old & BUSY) && old != (f & FRAME_MASK) &&
+         atomic_compare_exchange_strong(&h->token[s], &old, (f & FRAME_MASK) | BUSY);
+}
+
+static void token_release(WallHead *h, int s, uint32_t f) {
+  atomic_store_explicit(&h->token[s], f & FRAME_MASK, memory_order_release);
+}
+
+// Count shard s in frame f's update barrier, once, whoever gets there first.
+static void mark_updated(WallHead *h, int s, uint32_t f) {
+  uint32_t d = atomic_load_explicit(&h->did_update[s], memory_order_acquire);
+  if (d == f || !atomic_compare_exchange_strong(&h->did_update[s], &d, f)) return;
+  if (atomic_fetch_add_explicit(&h->updated, 1, memory_order_acq_rel) + 1 ==
+      (uint32_t)h->nshards)
+    futex_wake(&h->updated);
+}
+
+// ---------------------------------------------------------------------------
+// Host
+
+// Update shard s for frame f, unless its renderer is still inside an
+// update; then the shard sits this frame out, but the barrier still opens.
+static void host_update(WallHead *h, em_ctx **ctx, int s, uint32_t f) {
+  if (token_take(h, s, f)) {
+    em_update(ctx[s], h->t);
+    token_release(h, s, f);
+  }
+  mark_updated(h, s, f);
+}
+
+// A renderer that has let go of its shard, or died, since the frame began.
+static int dropped(WallHead *h, int s) {
+  int pid = h->owner[s];
+  return atomic_load_explicit(&h->claim[s], memory_order_relaxed) != pid || !alive(pid);
+}
+
+static void host_frame(WallHead *h, em_ctx **ctx, double t) {
+  uint32_t f = atomic_load_explicit(&h->frame, memory_order_relaxed) + 1;
+  int wait[WALL_MAX_SHARDS];
+  for (int s = 0; s < h->nshards; s++) {
+    int pid = atomic_load_explicit(&h->claim[s], memory_order_acquire);
+    if (pid && !alive(pid) &&
+        atomic_compare_exchange_strong(&h->claim[s], &pid, 0))
+      pid = 0;
+    if (atomic_load_explicit(&h->stalled[s], memory_order_acquire)) pid = 0;
+    h->owner[s] = pid;
+    wait[s] = pid != 0;
+  }
+  h->t = t;
+  atomic_store_explicit(&h->updated, 0, memory_order_relaxed);
+  atomic_store_explicit(&h->frame, f, memory_order_release);
+  futex_wake(&h->frame);
+
+  for (int s = 0; s < h->nshards; s++)
+    if (!wait[s]) host_update(h, ctx, s, f);
+
+  // Wait for every renderer in the frame, taking over the update of any
+  // that dropped out before doing it. One that is stopped, busy or stuck
+  // writing to its terminal past the deadline is stalled: the host takes
+  // its shard over until it shows up for a frame again.
+  double deadline = now_seconds() + STALL_MS * 1e-3;
+  for (;;) {
+    int late = now_seconds() >= deadline;
+    uint32_t seen = atomic_load_explicit(&h->done, memory_order_acquire);
+    int waiting = 0;
+    for (int s = 0; s < h->nshards; s++) {
+      if (!wait[s]) continue;
+      if (atomic_load_explicit(&h->did_draw[s], memory_order_acquire) == f) {
+        wait[s] = 0;
+      } else if (dropped(h, s) || late) {
+        if (atomic_load_explicit(&h->did_update[s], memory_order_acquire) != f)
+          host_update(h, ctx, s, f);
+        if (late) atomic_store_explicit(&h->stalled[s], 1, memory_order_release);
+        wait[s] = 0;
+      } else {
+        waiting = 1;
+      }
+    }
+    if (!waiting) break;
+    int ms = (int)((deadline - now_seconds()) * 1e3) + 1;
+    futex_wait(&h->done, seen, ms < POLL_MS ? ms : POLL_MS);
+  }
+}
+
+// An existing segment whose host has gone can be replaced.
+static int stale(const char *path) {
+  int fd = shm_open(path, O_RDWR, 0);
+  if (fd < 0) return errno == ENOENT;
+  size_t size;
+  WallHead *h = map_wall(fd, &size);
+  close(fd);
+  if (!h) return 0;
+  int gone = !host_alive(h);
+  munmap(h, size);
+  return gone;
+}
+
+int wall_host(const char *name, const em_config *cfg, int rows, int cols, int nshards,
+              int frame_us) {
+  char path[256];
+  if (shm_path(name, path, sizeof(path)) < 0) return 2;
+  size_t asize = nshards <= WALL_MAX_SHARDS ? em_wall_size(cfg, rows, cols, nshards) : 0;
+  if (!asize) {
+    fprintf(stderr, "ematrix: can't split a %dx%d wall into %d shards (at most %d)\n",
+            cols, rows, nshards, WALL_MAX_SHARDS);
+    return 2;
+  }
+  size_t size = HEAD_SIZE + asize;
+
+  int fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0 && errno == EEXIST && stale(path)) {
+    shm_unlink(path);
+    fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+  }
+  if (fd < 0) {
+    fprintf(stderr, "ematrix: can't create wall %s: %s\n", path,
+            errno == EEXIST ? "another host is running it" : strerror(errno));
+    return 1;
+  }
+  void *m = ftruncate(fd, (off_t)size) == 0
+              ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+              : MAP_FAILED;
+  close(fd);
+  if (m == MAP_FAILED) {
+    fprintf(stderr, "ematrix: can't map wall %s: %s\n", path, strerror(errno));
+    shm_unlink(path);
+    return 1;
+  }
+
+  // ftruncate zeroed the segment; the magic goes in last.
+  WallHead *h = (WallHead *)m;
+  void *arena = (char *)m + HEAD_SIZE;
+  em_ctx *ctx[WALL_MAX_SHARDS] = {0};
+  int ok = em_wall_format(arena, cfg, rows, cols, nshards) == 0;
+  for (int s = 0; ok && s < nshards; s++)
+    ok = (ctx[s] = em_wall_attach(arena, cfg, s, 0, 0, 1, 1)) != NULL;
+  if (!ok) {
+    fprintf(stderr, "ematrix: out of memory setting up the wall\n");
+    for (int s = 0; s < nshards; s++) em_destroy(ctx[s]);
+    munmap(m, size);
+    shm_unlink(path);
+    return 1;
+  }
+  h->size = size;
+  h->rows = rows;
+  h->cols = cols;
+  h->nshards = nshards;
+  atomic_store(&h->host, (int)getpid());
+  atomic_thread_fence(memory_order_release);
+  h->magic = WALL_SHM_MAGIC;
+  fprintf(stderr, "ematrix: wall %s up: %dx%d cells in %d shards (/dev/shm%s)\n",
+          name, cols, rows, nshards, path);
+
+  // Termination arrives through a signalfd, like the renderers' does.
+  sigset_t sigs;
+  sigemptyset(&sigs);
+  sigaddset(&sigs, SIGTERM);
+  sigaddset(&sigs, SIGINT);
+  sigaddset(&sigs, SIGHUP);
+  sigprocmask(SIG_BLOCK, &sigs, NULL);
+  int ep  = epoll_create1(EPOLL_CLOEXEC);
+  int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  int sfd = signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC);
+  struct itimerspec its = {{0, frame_us * 1000L}, {0, frame_us * 1000L}};
+  struct epoll_event ev = {0};
+  ev.events = EPOLLIN;
+  ev.data.fd = tfd; epoll_ctl(ep, EPOLL_CTL_ADD, tfd, &ev);
+  ev.data.fd = sfd; epoll_ctl(ep, EPOLL_CTL_ADD, sfd, &ev);
+  timerfd_settime(tfd, 0, &its, NULL);
+
+  double t0 = now_seconds();
+  int status = 0, quit = 0;
+  if (ep < 0 || tfd < 0 || sfd < 0) perror("ematrix: event setup"), status = 1;
+  while (!status && !quit) {
+    struct epoll_event evs[2];
+    int nev = epoll_wait(ep, evs, 2, -1);
+    if (nev < 0 && errno != EINTR) {
+      perror("ematrix: epoll_wait");
+      status = 1;
+    }
+    int tick = 0;
+    for (int e = 0; e < nev; e++) {
+      uint64_t expirations;
+      if (evs[e].data.fd == tfd) tick = read(tfd, &expirations, sizeof(expirations)) > 0;
+      else quit = 1;
+    }
+    // Late frames are dropped, not queued: the clock is real time.
+    if (tick && !quit) host_frame(h, ctx, now_seconds() - t0);
+  }
+
+  // Renderers notice the host has gone at their next wait.
+  atomic_store(&h->host, 0);
+  futex_wake(&h->frame);
+  futex_wake(&h->updated);
+  close(ep); close(tfd); close(sfd);
+  for (int s = 0; s < nshards; s++) em_destroy(ctx[s]);
+  shm_unlink(path);
+  munmap(m, size);
+  return status;
+}
+
+// ---------------------------------------------------------------------------
+// Renderer
+
+Wall *wall_join(const char *name) {
+  char path[256];
+  if (shm_path(name, path, sizeof(path)) < 0) return NULL;
+  int fd = shm_open(path, O_RDWR, 0);
+  if (fd < 0) {
+    fprintf(stderr, "ematrix: no wall %s (start one with --wall-host %s)\n", name, name);
+    return NULL;
+  }
+  size_t size;
+  WallHead *h = map_wall(fd, &size);
+  close(fd);
+  if (!h || !host_alive(h)) {
+    fprintf(stderr, "ematrix: wall %s isn't running\n", name);
+    if (h) munmap(h, size);
+    return NULL;
+  }
+
+  int pid = (int)getpid(), s;
+  for (s = 0; s < h->nshards; s++) {
+    int free_slot = 0;
+    if (atomic_compare_exchange_strong(&h->claim[s], &free_slot, pid)) break;
+  }
+  if (s == h->nshards) {
+    fprintf(stderr, "ematrix: all %d shards of wall %s are taken\n", h->nshards, name);
+    munmap(h, size);
+    return NULL;
+  }
+  Wall *w = (Wall *)calloc(1, sizeof(*w));
+  if (!w) {
+    atomic_store(&h->claim[s], 0);
+    munmap(h, size);
+    return NULL;
+  }
+  w->head = h;
+  w->size = size;
+  w->shard = s;
+  w->pid = pid;
+  w->seen = atomic_load_explicit(&h->frame, memory_order_acquire);
+  return w;
+}
+
+em_ctx *wall_attach(Wall *w, const em_config *cfg, int y, int x, int rows, int cols) {
+  em_destroy(w->ctx);
+  w->ctx = em_wall_attach((char *)w->head + HEAD_SIZE, cfg, w->shard, y, x, rows, cols);
+  return w->ctx;
+}
+
+int wall_next_frame(Wall *w, int timeout_ms, double *t) {
+  WallHead *h = w->head;
+  uint32_t f = atomic_load_explicit(&h->frame, memory_order_acquire);
+  if (f == w->seen) {
+    if (!host_alive(h)) return -1;
+    futex_wait(&h->frame, f, timeout_ms);
+    f = atomic_load_explicit(&h->frame, memory_order_acquire);
+    if (f == w->seen) return 0;
+  }
+  w->seen = f;
+  // Claimed after the host set this frame up, or back from a stall: join
+  // at the next one. Nor can a frame whose update the host has taken.
+  if (h->owner[w->shard] != w->pid) {
+    if (atomic_load_explicit(&h->stalled[w->shard], memory_order_relaxed))
+      atomic_store_explicit(&h->stalled[w->shard], 0, memory_order_release);
+    return 0;
+  }
+  if (!token_take(h, w->shard, f)) return 0;
+  *t = h->t;
+  return 1;
+}
+
+int wall_updated(Wall *w) {
+  WallHead *h = w->head;
+  uint32_t n = (uint32_t)h->nshards;
+  token_release(h, w->shard, w->seen);
+  mark_updated(h, w->shard, w->seen);
+  for (int spin = 0;; spin++) {
+    uint32_t u = atomic_load_explicit(&h->updated, memory_order_acquire);
+    if (u >= n) return 0;
+    if (spin < SPINS) continue;
+    if (futex_wait(&h->updated, u, POLL_MS) < 0 && errno == ETIMEDOUT && !host_alive(h))
+      return -1;
+  }
+}
+
+void wall_done(Wall *w) {
+  WallHead *h = w->head;
+  atomic_store_explicit(&h->did_draw[w->shard], w->seen, memory_order_release);
+  atomic_fetch_add_explicit(&h->done, 1, memory_order_release);
+  futex_wake(&h->done);
+}
+
+void wall_leave(Wall *w) {
+  if (!w) return;
+  em_destroy(w->ctx);
+  int pid = w->pid;
+  atomic_compare_exchange_strong(&w->head->claim[w->shard], &pid, 0);
+  munmap(w->head, w->size);
+  free(w);
+}
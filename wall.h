@@ -0,0 +1,57 @@
+// Video wall (--wall-host, --wall): one simulation spread over many
+// terminals on this machine through POSIX shared memory.
+//
+// The host creates /dev/shm/ematrix-wall-NAME holding the canvas's
+// libematrix arena (see em_wall_attach()) and a shared clock, and paces
+// frames. Each renderer claims one of the arena's shards and shows a
+// viewport of the canvas in its own terminal. A frame goes:
+//
+//   host:      publish t, bump the frame number
+//   renderers: em_update their shard, arrive at the update barrier
+//              (the host updates the shards nobody holds), then compose
+//              their viewport, draw it and report the frame done
+//   host:      wait for every renderer that took part, then next frame
+//
+// The barriers are atomic counters in the segment; waiters spin briefly
+// and then sleep on a futex. Renderers that quit or die drop out at the
+// next frame and the host takes their shards over, so nobody waits on
+// them for longer than a poll interval. One that is stopped, busy or
+// blocked on its terminal gets 250 ms a frame; after that the host
+// updates its shard too until it turns up for a frame again.
+
+#ifndef EMATRIX_WALL_H
+#define EMATRIX_WALL_H
+
+#include "ematrix.h"
+
+#define WALL_MAX_SHARDS 64
+
+typedef struct Wall Wall;
+
+// Run the host for a rows x cols canvas of nshards shards, a frame every
+// frame_us, until SIGINT, SIGTERM or SIGHUP. Returns the exit status;
+// errors go to stderr.
+int wall_host(const char *name, const em_config *cfg, int rows, int cols, int nshards,
+              int frame_us);
+
+// Map NAME's wall and claim a free shard. NULL, with a message on stderr,
+// when there is no such wall or every shard is taken.
+Wall *wall_join(const char *name);
+
+// The claimed shard's context (see em_wall_attach()), owned by w, with a
+// rows x cols viewport at canvas cell (y, x). NULL on allocation failure.
+em_ctx *wall_attach(Wall *w, const em_config *cfg, int y, int x, int rows, int cols);
+
+// Wait up to timeout_ms for a frame this renderer takes part in. 1: run
+// it (em_update(ctx, *t), wall_updated(), em_compose(), draw, then
+// wall_done()); 0: nothing yet; -1: the host has gone.
+int  wall_next_frame(Wall *w, int timeout_ms, double *t);
+// After em_update: returns once every shard has been updated (0), or -1
+// when the host has gone.
+int  wall_updated(Wall *w);
+void wall_done(Wall *w);
+
+// Give the shard back and detach; destroys the context.
+void wall_leave(Wall *w);
+
+#endif
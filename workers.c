@@ -0,0 +1,139 @@
+// Thread pool for batches of tasks (see workers.h).
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "workers.h"
+
+struct Workers {
+  int n;                  // threads including the caller
+  pthread_t *threads;     // n - 1
+  pthread_mutex_t lock;
+  pthread_cond_t start;   // a new batch, or quit
+  pthread_cond_t done;    // the last helper left the batch
+  unsigned long batch;    // bumped for every batch
+  int busy;               // helpers still inside the current batch
+  int quit;
+
+  void (*event)(const char *name, char phase);  // tracing, see workers_trace
+  void (*thread_name)(const char *name);
+
+  const char *name;
+  void (*fn)(void *arg, int task);
+  void *arg;
+  int ntasks;
+  _Atomic int next;       // next unclaimed task
+};
+
+static void run_tasks(Workers *w) {
+  for (;;) {
+    int t = atomic_fetch_add_explicit(&w->next, 1, memory_order_relaxed);
+    if (t >= w->ntasks) return;
+    if (w->event) w->event(w->name, 'B');
+    w->fn(w->arg, t);
+    if (w->event) w->event(w->name, 'E');
+  }
+}
+
+static void *helper_main(void *p) {
+  Workers *w = (Workers *)p;
+  unsigned long seen = 0;
+  void (*named)(const char *) = NULL;
+  pthread_mutex_lock(&w->lock);
+  for (;;) {
+    while (w->batch == seen && !w->quit) pthread_cond_wait(&w->start, &w->lock);
+    if (w->quit) break;
+    seen = w->batch;
+    pthread_mutex_unlock(&w->lock);
+    if (w->thread_name && named != w->thread_name) {
+      named = w->thread_name;
+      named("worker");
+    }
+    run_tasks(w);
+    pthread_mutex_lock(&w->lock);
+    if (--w->busy == 0) pthread_cond_signal(&w->done);
+  }
+  pthread_mutex_unlock(&w->lock);
+  return NULL;
+}
+
+Workers *workers_create(int n) {
+  Workers *w = (Workers *)calloc(1, sizeof(*w));
+  if (!w) return NULL;
+  w->n = n > 1 ? n : 1;
+  w->threads = (pthread_t *)calloc((size_t)w->n, sizeof(pthread_t));
+  if (!w->threads) {
+    free(w);
+    return NULL;
+  }
+  pthread_mutex_init(&w->lock, NULL);
+  pthread_cond_init(&w->start, NULL);
+  pthread_cond_init(&w->done, NULL);
+
+  // Helpers never take a signal meant for the caller's signalfd.
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  int started = 0;
+  while (started < w->n - 1 && pthread_create(&w->threads[started], NULL, helper_main, w) == 0)
+    started++;
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (started < w->n - 1) {
+    w->n = started + 1;
+    workers_destroy(w);
+    return NULL;
+  }
+  return w;
+}
+
+void workers_destroy(Workers *w) {
+  if (!w) return;
+  pthread_mutex_lock(&w->lock);
+  w->quit = 1;
+  pthread_cond_broadcast(&w->start);
+  pthread_mutex_unlock(&w->lock);
+  for (int i = 0; i < w->n - 1; i++) pthread_join(w->threads[i], NULL);
+  pthread_cond_destroy(&w->done);
+  pthread_cond_destroy(&w->start);
+  pthread_mutex_destroy(&w->lock);
+  free(w->threads);
+  free(w);
+}
+
+int workers_count(const Workers *w) {
+  return w ? w->n : 1;
+}
+
+void workers_trace(Workers *w, void (*event)(const char *name, char phase),
+                   void (*thread_name)(const char *name)) {
+  if (!w) return;
+  w->event = event;
+  w->thread_name = thread_name;
+}
+
+void workers_run(Workers *w, const char *name, int ntasks, void (*fn)(void *arg, int task),
+                 void *arg) {
+  if (!w || w->n == 1 || ntasks <= 1) {
+    for (int t = 0; t < ntasks; t++) fn(arg, t);
+    return;
+  }
+  pthread_mutex_lock(&w->lock);
+  w->name = name;
+  w->fn = fn;
+  w->arg = arg;
+  w->ntasks = ntasks;
+  atomic_store_explicit(&w->next, 0, memory_order_relaxed);
+  w->busy = w->n - 1;
+  w->batch++;
+  pthread_cond_broadcast(&w->start);
+  pthread_mutex_unlock(&w->lock);
+
+  run_tasks(w);
+
+  // The mutex orders every helper's writes before our return.
+  pthread_mutex_lock(&w->lock);
+  while (w->busy) pthread_cond_wait(&w->done, &w->lock);
+  pthread_mutex_unlock(&w->lock);
+}
@@ -0,0 +1,33 @@
+// A small fixed pool of threads that runs batches of numbered tasks.
+//
+// workers_run(w, name, n, fn, arg) calls fn(arg, 0) .. fn(arg, n - 1), each
+// exactly once, spread over the pool and the calling thread, and returns
+// when all of them have finished. Tasks are claimed in order from a
+// shared counter, so uneven ones balance out. A batch doesn't allocate.
+// One batch at a time per pool: a pool belongs to whoever created it,
+// though it can lend it out (em_config.workers) between its own batches.
+
+#ifndef EMATRIX_WORKERS_H
+#define EMATRIX_WORKERS_H
+
+typedef struct Workers Workers;
+
+// n threads in all, counting the caller's (so n - 1 are started). n <= 1
+// gives a pool that runs every batch on the caller. NULL on failure.
+// The threads start with every signal blocked.
+Workers *workers_create(int n);
+void     workers_destroy(Workers *w);
+
+int  workers_count(const Workers *w);
+// name labels the batch's tasks in a trace; a string literal.
+void workers_run(Workers *w, const char *name, int ntasks, void (*fn)(void *arg, int task),
+                 void *arg);
+
+// Tracing without a link to it (trace.h's trace_event and
+// trace_thread_name fit): the helpers name themselves "worker", and every
+// task, on whichever thread runs it, is a span named after its batch.
+// Set it between batches; NULLs turn it off.
+void workers_trace(Workers *w, void (*event)(const char *name, char phase),
+                   void (*thread_name)(const char *name));
+
+#endif